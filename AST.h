@@ -5,9 +5,11 @@
 #include <set>
 #include <string>
 #include <sstream>
-#include <memory>
 
+#include "Arena.h"
+#include "Diagnostic.h"
 #include "Expression.h"
+#include "Source.h"
 #include "Type.h"
 #include "Symbol.h"
 
@@ -15,6 +17,7 @@ using namespace std;
 
 class ModuleNode;
 class FunctionNode;
+class Global;
 class Block;
 class Statement;
 class Assignment;
@@ -23,85 +26,154 @@ class Return;
 class FunctionCall;
 class If;
 class While;
+class Switch;
 
 class ErrorCollector;
 class SymbolTable;
+struct CompileOptions;
 
-ModuleNode* parse(const string&, const string&);
+ModuleNode* parse(Source&, const string&);
+
+// State shared between the scanner and the parser of a single module, this
+// keeps the parser reentrant so modules can be parsed concurrently
+struct ParseContext {
+    ModuleNode* module;
+    Arena* arena;
+    SourceLocation location;
+    Name moduleName;
+    // The first syntax error, parse() throws it once the parser has stopped
+    bool failed = false;
+    Diagnostic error;
+    // Set by new and delete, the module then imports mem
+    bool usesHeap = false;
+    // Literals of 2^63, which are only in range when they are negated
+    vector<Expression*> minimumLiterals;
+};
 
 struct Import {
     SourceText path;
     bool isAssembly;
+    // Only looked up in the library directory, so that a module next to the
+    // importer can't take its place. Set for the imports the compiler adds.
+    bool isLibrary;
 };
 
+// Variables declared outside of functions, seen by the functions of their
+// module only. They are zeroed in .bss unless they have initial values,
+// then they are in .data, or in .rodata if they are constants.
+struct Global {
+    SourceLocation location;
+    Type* type;
+    vector<Symbol> ids;
+    // Literals, one for each 8 byte element in memory order. Elements
+    // without a value are zeroed.
+    vector<Expression*> values;
+    bool isConstant;
+    vector<Variable*> variables;
+
+    Global(Type* type, const vector<Symbol>& ids,
+           const vector<Expression*>& values, bool isConstant) {
+        this->type = type;
+        this->ids = ids;
+        this->values = values;
+        this->isConstant = isConstant;
+        location = type->location;
+    }
+    string toString() const;
+    bool validate(SymbolTable&, ErrorCollector&);
+};
+
+// A module owns the arena all of its nodes, types and symbols live in
 struct ModuleNode {
-    vector<shared_ptr<FunctionNode>> functions;
+    Arena arena;
+    vector<FunctionNode*> functions;
+    vector<Global*> globals;
     vector<Import> imports;
     vector<string> strings;
-    char** sourceLines;
     string name;
 
     string toString() const;
-    string validate(SymbolTable&);
-    void cgen(ostream&);
+    vector<Diagnostic> validate(SymbolTable&, const Source&);
+    // The two halves of validate, the signatures of every function and the
+    // globals have to be declared before any body is validated
+    void validateSignatures(SymbolTable&, ErrorCollector&);
+    void validateBody(FunctionNode*, SymbolTable&, ErrorCollector&);
+
+    // Generates the functions for which live is set, all of them if live
+    // is empty, followed by the data of the module
+    void cgen(CodeBuffer&, const CompileOptions&,
+              const vector<bool>& live = vector<bool>());
+    // The code of each function in its own buffer, as laid out by cgen
+    void cgenFunctions(vector<CodeBuffer>&, const CompileOptions&,
+                       const vector<bool>& live);
+    void cgenData(CodeBuffer&, const CompileOptions&);
 };
 
 struct FunctionNode {
     SourceLocation location;
-    vector<unique_ptr<Declaration>> arguments;
-    vector<shared_ptr<Variable>> locals;
-    unique_ptr<Block> block;
-    shared_ptr<Type> returnType;
+    vector<Declaration*> arguments;
+    vector<Variable*> locals;
+    Block* block = nullptr;
+    Type* returnType;
     Symbol id;
     int stackSpaceForArgs = 0;
     int stackSpaceForLocals = 0;
     int temporarySpace = 0;
     bool isTailRecursive = true;
     set<FunctionCall*> tailCalls;
+    set<FunctionNode*> callees;
+    // Neither reads nor writes memory other than its own frame and only
+    // calls pure functions, set by the whole program passes
+    bool isPure = false;
 
     string toString() const;
     bool validateSignature(SymbolTable&, ErrorCollector&);
     bool validateBody(SymbolTable&, ErrorCollector&);
-    void cgen(ostream&);
+    void cgen(CodeBuffer&);
 };
 
 struct Block {
     SourceLocation location;
-    vector<unique_ptr<Statement>> statements;
+    vector<Statement*> statements;
 
     string toString(int currentIndentLevel) const;
     bool validate(SymbolTable&, ErrorCollector&);
-    void cgen(ostream&);
+    void cgen(CodeBuffer&);
 };
 
+// Dispatched on kind like Expression
 struct Statement {
     SourceLocation location;
+    NodeKind kind;
 
+    Statement(NodeKind kind) {
+        this->kind = kind;
+    }
     string toString() const {return toString(0);}
-    virtual string toString(int currentIndentLevel) const = 0;
-    virtual void cgen(ostream&) {};
-    virtual bool validate(SymbolTable&, ErrorCollector&) = 0;
-    virtual ~Statement() {}
+    string toString(int currentIndentLevel) const;
+    void cgen(CodeBuffer&);
+    bool validate(SymbolTable&, ErrorCollector&);
 };
 
 // TODO: this should really reuse code from BinaryOpExpression
 struct Assignment : public Statement {
-    unique_ptr<Expression> rhs;
-    unique_ptr<Expression> lhs;
-    
+    Expression* rhs;
+    Expression* lhs;
+
+    Assignment() : Statement(NK_ASSIGNMENT) {}
     string toString(int currentIndentLevel) const;
     bool validate(SymbolTable&, ErrorCollector&);
-    void cgen(ostream&);
+    void cgen(CodeBuffer&);
 };
 
 struct Declaration : public Statement {
-    shared_ptr<Type> type;
+    Type* type;
     vector<Symbol> ids;
     bool inOuterBlock = false;
 
-    Declaration(Type* type,
-                const vector<Symbol>& ids) {
-        this->type.reset(type);
+    Declaration(Type* type, const vector<Symbol>& ids)
+        : Statement(NK_DECLARATION) {
+        this->type = type;
         this->ids = ids;
         location = type->location;
     }
@@ -111,94 +183,134 @@ struct Declaration : public Statement {
 };
 
 struct Return : public Statement {
-    unique_ptr<Expression> expr;
+    Expression* expr;
 
-    Return(Expression* expr) {
-        this->expr.reset(expr);
+    Return(Expression* expr) : Statement(NK_RETURN) {
+        this->expr = expr;
     }
     string toString(int currentIndentLevel) const;
     bool validate(SymbolTable&, ErrorCollector&);
-    void cgen(ostream&);
+    void cgen(CodeBuffer&);
+};
+
+// new(T) and new(T, count) are calls to mem:alloc with the count and the
+// size of T, delete is a call to mem:free
+enum Builtin {
+    BUILTIN_NONE,
+    BUILTIN_NEW,
+    BUILTIN_NEW_ARRAY,
+    BUILTIN_DELETE
 };
 
 struct FunctionCall : public Statement, public Expression {
     Symbol id;
-    shared_ptr<FunctionNode> function;
-    vector<unique_ptr<Expression>> arguments;
+    FunctionNode* function = nullptr;
+    vector<Expression*> arguments;
+    Builtin builtin = BUILTIN_NONE;
+    // The T of new
+    Type* allocated = nullptr;
 
+    FunctionCall()
+        : Statement(NK_FUNCTION_CALL), Expression(NK_FUNCTION_CALL) {}
     string toString() const;
     string toString(int currentIndentLevel) const;
     bool validate(SymbolTable&, ErrorCollector&);
-    void cgen(ostream&);
-    void cgen(ostream&, bool);
+    bool validateNew(SymbolTable&, ErrorCollector&);
+    void cgen(CodeBuffer&);
+    void cgen(CodeBuffer&, bool);
     bool isAddressable() const {return false;}
 };
 
 struct If : public Statement {
-    unique_ptr<Block> block;
-    unique_ptr<Expression> predicate;
-    unique_ptr<If> elseClause;
-
-    If(Expression* predicate, Block* block, If* elseClause) {
-        this->block.reset(block);
-        this->predicate.reset(predicate);
-        this->elseClause.reset(elseClause);
+    Block* block;
+    Expression* predicate;
+    If* elseClause;
+
+    If(Expression* predicate, Block* block, If* elseClause)
+        : Statement(NK_IF) {
+        this->block = block;
+        this->predicate = predicate;
+        this->elseClause = elseClause;
     }
     string toString(int currentIndentLevel) const;
     bool validate(SymbolTable&, ErrorCollector&);
-    void cgen(ostream&);
+    void cgen(CodeBuffer&);
 };
 
 struct While : public Statement {
-    unique_ptr<Expression> expr;
-    unique_ptr<Block> block;
+    Expression* expr;
+    Block* block;
 
-    While(Expression* expr, Block* block) {
-        this->expr.reset(expr);
-        this->block.reset(block);
+    While(Expression* expr, Block* block) : Statement(NK_WHILE) {
+        this->expr = expr;
+        this->block = block;
     }
     string toString(int currentIndentLevel) const;
     bool validate(SymbolTable&, ErrorCollector&);
-    void cgen(ostream&);
+    void cgen(CodeBuffer&);
+};
+
+struct SwitchCase {
+    SourceLocation location;
+    vector<long> values;
+    Block* block;
+
+    SwitchCase(const vector<long>& values, Block* block) {
+        this->values = values;
+        this->block = block;
+    }
+};
+
+struct Switch : public Statement {
+    Expression* expr;
+    vector<SwitchCase*> cases;
+    Block* defaultBlock;
+
+    Switch(Expression* expr, const vector<SwitchCase*>& cases,
+           Block* defaultBlock) : Statement(NK_SWITCH) {
+        this->expr = expr;
+        this->cases = cases;
+        this->defaultBlock = defaultBlock;
+    }
+    string toString(int currentIndentLevel) const;
+    bool validate(SymbolTable&, ErrorCollector&);
+    void cgen(CodeBuffer&);
 };
 
 struct RangeFor : public Statement {
-    unique_ptr<Declaration> decl;
-    shared_ptr<Variable> var;
-    unique_ptr<Expression> start;
-    unique_ptr<Expression> end;
-    unique_ptr<Block> block;
-
-    RangeFor(Type* type, const Symbol& id, Expression* start,
-             Expression* end, Block* block) {
-        vector<Symbol> ids;
-        ids.push_back(id);
-        this->decl.reset(new Declaration(type, move(ids)));
-        this->start.reset(start);
-        this->end.reset(end);
-        this->block.reset(block);
+    Declaration* decl;
+    Variable* var = nullptr;
+    Expression* start;
+    Expression* end;
+    Block* block;
+
+    RangeFor(Declaration* decl, Expression* start, Expression* end,
+             Block* block) : Statement(NK_RANGE_FOR) {
+        this->decl = decl;
+        this->start = start;
+        this->end = end;
+        this->block = block;
     }
     string toString(int currentIndentLevel) const;
     bool validate(SymbolTable&, ErrorCollector&);
-    void cgen(ostream&);
+    void cgen(CodeBuffer&);
 };
 
 struct ArrayFor : public Statement {
-    unique_ptr<Declaration> decl;
-    shared_ptr<Variable> var;
-    unique_ptr<Expression> arrayExpr;
-    unique_ptr<Block> block;
-
-    ArrayFor(Type* type, const Symbol& id, Expression* arrayExpr, Block* block) {
-        vector<Symbol> ids;
-        ids.push_back(id);
-        this->decl.reset(new Declaration(type, move(ids)));
-        this->arrayExpr.reset(arrayExpr);
-        this->block.reset(block);
+    Declaration* decl;
+    Variable* var = nullptr;
+    Expression* arrayExpr;
+    Block* block;
+
+    ArrayFor(Declaration* decl, Expression* arrayExpr, Block* block)
+        : Statement(NK_ARRAY_FOR) {
+        this->decl = decl;
+        this->arrayExpr = arrayExpr;
+        this->block = block;
     }
     string toString(int currentIdentLevel) const;
     bool validate(SymbolTable&, ErrorCollector&);
-    void cgen(ostream&);
+    void cgen(CodeBuffer&);
 };
 
 #endif
@@ -0,0 +1,80 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator owning the AST, types and symbols of a module. Objects are
+// never freed one by one, they are all destroyed together with the arena.
+// An arena must only be used by one thread at a time.
+class Arena {
+private:
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+    struct Destructor {
+        void (*destroy)(void*);
+        void* object;
+    };
+
+    std::vector<char*> blocks;
+    std::vector<Destructor> destructors;
+    char* next = nullptr;
+    size_t remaining = 0;
+
+    template <typename T>
+    static void destroy(void* object) {
+        static_cast<T*>(object)->~T();
+    }
+
+    void* allocate(size_t size, size_t alignment) {
+        size_t padding = (alignment - (size_t)next % alignment) % alignment;
+
+        if (padding + size > remaining) {
+            size_t blockSize = size + alignment > BLOCK_SIZE ?
+                               size + alignment : BLOCK_SIZE;
+            char* block = (char*)malloc(blockSize);
+            if (block == nullptr) {
+                throw std::bad_alloc();
+            }
+            blocks.push_back(block);
+            next = block;
+            remaining = blockSize;
+            padding = (alignment - (size_t)next % alignment) % alignment;
+        }
+
+        void* memory = next + padding;
+        next += padding + size;
+        remaining -= padding + size;
+        return memory;
+    }
+
+public:
+    Arena() {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        for (size_t i = destructors.size(); i > 0; i--) {
+            destructors[i-1].destroy(destructors[i-1].object);
+        }
+        for (char* block : blocks) {
+            free(block);
+        }
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* object = new (allocate(sizeof(T), alignof(T)))
+                        T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            destructors.push_back(Destructor{&destroy<T>, object});
+        }
+        return object;
+    }
+};
+
+#endif
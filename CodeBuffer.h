@@ -0,0 +1,123 @@
+#ifndef CODE_BUFFER_H
+#define CODE_BUFFER_H
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+using namespace std;
+
+// Append only buffer generated assembly is written into. It grows like a
+// vector, keeps its capacity when cleared and formats integers itself,
+// which is a lot cheaper than an ostream for the many short writes of the
+// code generator.
+class CodeBuffer {
+private:
+    string data;
+
+    CodeBuffer& appendUnsigned(unsigned long long n, bool negative) {
+        char digits[21];
+        char* end = digits + sizeof(digits);
+        char* p = end;
+        do {
+            *--p = '0' + n % 10;
+            n /= 10;
+        } while (n != 0);
+        if (negative) {
+            data.push_back('-');
+        }
+        data.append(p, end - p);
+        return *this;
+    }
+
+    CodeBuffer& appendSigned(long long n) {
+        if (n < 0) {
+            return appendUnsigned(0ULL - (unsigned long long)n, true);
+        }
+        return appendUnsigned(n, false);
+    }
+public:
+    CodeBuffer& operator<<(const string& str) {
+        data.append(str);
+        return *this;
+    }
+
+    CodeBuffer& operator<<(const char* str) {
+        data.append(str);
+        return *this;
+    }
+
+    CodeBuffer& operator<<(char c) {
+        data.push_back(c);
+        return *this;
+    }
+
+    CodeBuffer& operator<<(const CodeBuffer& other) {
+        data.append(other.data);
+        return *this;
+    }
+
+    CodeBuffer& operator<<(int n) {
+        return appendSigned(n);
+    }
+
+    CodeBuffer& operator<<(long n) {
+        return appendSigned(n);
+    }
+
+    CodeBuffer& operator<<(long long n) {
+        return appendSigned(n);
+    }
+
+    CodeBuffer& operator<<(unsigned n) {
+        return appendUnsigned(n, false);
+    }
+
+    CodeBuffer& operator<<(unsigned long n) {
+        return appendUnsigned(n, false);
+    }
+
+    CodeBuffer& operator<<(unsigned long long n) {
+        return appendUnsigned(n, false);
+    }
+
+    // Lower case hexadecimal digits, without a prefix
+    CodeBuffer& appendHex(uint64_t n) {
+        char digits[16];
+        int count = 0;
+        do {
+            digits[15 - count++] = "0123456789abcdef"[n & 0xf];
+            n >>= 4;
+        } while (n != 0);
+        data.append(digits + 16 - count, count);
+        return *this;
+    }
+
+    void append(const char* str, size_t length) {
+        data.append(str, length);
+    }
+
+    const string& str() const {
+        return data;
+    }
+
+    // Moves the contents out, leaving the buffer empty
+    string release() {
+        string result;
+        result.swap(data);
+        return result;
+    }
+
+    size_t size() const {
+        return data.size();
+    }
+
+    bool empty() const {
+        return data.empty();
+    }
+
+    void clear() {
+        data.clear();
+    }
+};
+
+#endif
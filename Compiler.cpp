@@ -0,0 +1,1387 @@
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "AST.h"
+#include "Compiler.h"
+#include "ErrorCollector.h"
+#include "Hash.h"
+#include "Interface.h"
+#include "Optimize.h"
+#include "Parallel.h"
+#include "Visitor.h"
+#include "cgen.h"
+
+using namespace std;
+
+bool DiskFileSystem::exists(const string& path)
+{
+    return access(path.c_str(), F_OK) != -1;
+}
+
+Source* DiskFileSystem::readFile(const string& path)
+{
+    return Source::map(path);
+}
+
+void MemoryFileSystem::addFile(const string& path, const string& contents)
+{
+    files[path] = contents;
+}
+
+bool MemoryFileSystem::exists(const string& path)
+{
+    return files.find(path) != files.end();
+}
+
+Source* MemoryFileSystem::readFile(const string& path)
+{
+    auto itr = files.find(path);
+    if (itr == files.end()) {
+        return nullptr;
+    }
+    // Every session gets its own copy, the lexer writes into it
+    return Source::copy(itr->second);
+}
+
+static string systemError(const string& message)
+{
+    return message + strerror(errno);
+}
+
+static double cpuSeconds(const rusage& usage)
+{
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// Peak resident set size of the process in kilobytes. Unlike ru_maxrss it
+// doesn't include the peak of the process that exec'ed the compiler.
+static long peakRSS()
+{
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return atol(line.c_str() + 6);
+        }
+    }
+    return 0;
+}
+
+// Runs an external tool and waits for it to finish, throws if it fails. The
+// wall time of running it and the CPU time of the tool are added to time.
+// Descriptors are close-on-exec, the tool only inherits the memory files
+// named in its arguments.
+static void runTool(const vector<string>& args, const string& failure,
+                    PhaseTime& time)
+{
+    PhaseTimer timer;
+
+    // Build everything before forking, the child may only exec
+    string execError = "Failed to execute " + args[0] + ": ";
+    vector<char*> argv;
+    vector<int> inherited;
+    const string fdPrefix = "/proc/self/fd/";
+    for (const string& arg : args) {
+        argv.push_back((char*)arg.c_str());
+        if (arg.compare(0, fdPrefix.length(), fdPrefix) == 0) {
+            inherited.push_back(atoi(arg.c_str() + fdPrefix.length()));
+        }
+    }
+    argv.push_back(NULL);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        for (int fd : inherited) {
+            fcntl(fd, F_SETFD, 0);
+        }
+        execvp(argv[0], argv.data());
+        perror(execError.c_str());
+        _exit(1);
+    } else if (pid > 0) {
+        int status;
+        rusage usage;
+        wait4(pid, &status, 0, &usage);
+        PhaseTime wall;
+        timer.stop(wall);
+        time.wall += wall.wall;
+        time.cpu += cpuSeconds(usage);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            throw CompileError(failure);
+        }
+    } else {
+        throw CompileError(systemError("Failed to fork " + args[0] + ": "));
+    }
+}
+
+static void assembleFile(const string& source, const string& object,
+                         PhaseTime& time)
+{
+    runTool({"nasm", "-f", "elf64", "-o", object, source}, "Assemble failed.",
+            time);
+}
+
+static void linkObjects(const vector<string>& objects, const string& output,
+                        PhaseTime& time)
+{
+    vector<string> args = {"ld", "-o", output};
+    args.insert(args.end(), objects.begin(), objects.end());
+    runTool(args, "Link failed.", time);
+}
+
+// A file in memory, external tools open it as /proc/self/fd/<fd> since
+// runTool lets them inherit the descriptor. It is close-on-exec otherwise,
+// so the tools of other sessions don't keep it open.
+struct MemoryFile {
+    int fd;
+    string path;
+
+    MemoryFile() {
+        fd = memfd_create("compiler", MFD_CLOEXEC);
+        if (fd == -1) {
+            throw CompileError(systemError("Failed to create memory file: "));
+        }
+        path = "/proc/self/fd/" + to_string(fd);
+    }
+
+    ~MemoryFile() {
+        close(fd);
+    }
+
+    void write(const string& contents) {
+        size_t written = 0;
+        while (written < contents.length()) {
+            ssize_t count = pwrite(fd, contents.data() + written,
+                                   contents.length() - written, written);
+            if (count <= 0) {
+                throw CompileError(systemError("Failed to write memory file: "));
+            }
+            written += count;
+        }
+    }
+
+    string read() {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            throw CompileError(systemError("Failed to read memory file: "));
+        }
+        string contents(st.st_size, '\0');
+        size_t done = 0;
+        while (done < contents.length()) {
+            ssize_t count = pread(fd, &contents[done],
+                                  contents.length() - done, done);
+            if (count <= 0) {
+                throw CompileError(systemError("Failed to read memory file: "));
+            }
+            done += count;
+        }
+        return contents;
+    }
+};
+
+static string getModuleName(string filePath)
+{
+    size_t slash = filePath.find_last_of('/');
+    if (slash != string::npos) {
+        filePath = filePath.substr(slash+1);
+    }
+    return filePath.substr(0, filePath.length());
+}
+
+// A validated library module and the code generated for it
+struct SharedModule {
+    // A copy of the source the module was compiled from. The pages of a
+    // mapped file follow later writes to it and fault once it is truncated.
+    shared_ptr<Source> source;
+    shared_ptr<ModuleNode> ast;
+
+    // Code of every function without and with tail call elimination, never
+    // changed once generated
+    mutex lock;
+    bool generated[2] = {false, false};
+    vector<string> functions[2];
+};
+
+shared_ptr<SharedModule> ModuleCache::find(const string& path,
+                                           const Source& source)
+{
+    lock_guard<mutex> guard(lock);
+    auto itr = modules.find(path);
+    if (itr == modules.end() || !itr->second->source->equals(source)) {
+        return nullptr;
+    }
+    return itr->second;
+}
+
+bool ModuleCache::add(const string& path,
+                      const shared_ptr<SharedModule>& module)
+{
+    lock_guard<mutex> guard(lock);
+    shared_ptr<SharedModule>& entry = modules[path];
+    if (entry != nullptr && entry->source->equals(*module->source)) {
+        return false;
+    }
+    entry = module;
+    return true;
+}
+
+// A node of the import graph, either a module parsed from a .u file or an
+// assembly file that is copied into the output as is
+struct ModuleUnit {
+    string dir;
+    string name;
+    bool isAssembly;
+    shared_ptr<Source> source;
+    shared_ptr<ModuleNode> ast;
+    shared_ptr<SharedModule> shared; // set if ast is shared with other sessions
+    vector<size_t> imports; // one unit per import of ast, in source order
+    CodeBuffer assembly;
+    bool generated = false;
+    ModuleStats stats;
+
+    // Functions reachable from main, everything is generated if empty. An
+    // assembly import is only needed if something it implements is reachable.
+    vector<bool> live;
+    bool needed = true;
+    // Some function bodies were not validated since nothing reaches them
+    bool partial = false;
+
+    // Object cache state, see writeObjects
+    bool fromInterface = false;
+    InterfaceInfo interface;
+    uint64_t interfaceHash = 0;
+    set<string> asmGlobals;
+};
+
+struct ModuleGraph {
+    const CompileOptions& options;
+    FileSystem& files;
+
+    vector<unique_ptr<ModuleUnit>> units;
+    unordered_map<string, size_t> index;
+    vector<size_t> order; // imported modules come before their importers
+    unordered_map<string, size_t> byName;
+
+    ModuleGraph(const CompileOptions& options, FileSystem& files)
+        : options(options), files(files) {}
+
+    size_t find(const string& key, const string& dir, const string& name,
+                bool isAssembly, bool& added)
+    {
+        auto itr = index.find(key);
+        if (itr != index.end()) {
+            added = false;
+            return itr->second;
+        }
+
+        unique_ptr<ModuleUnit> unit(new ModuleUnit());
+        unit->dir = dir;
+        unit->name = name;
+        unit->isAssembly = isAssembly;
+
+        index[key] = units.size();
+        units.push_back(move(unit));
+        added = true;
+        return units.size()-1;
+    }
+};
+
+static Source* readFile(ModuleGraph& graph, const string& workingDir,
+                        const string& fileName)
+{
+    Source* source = graph.files.readFile(workingDir + fileName);
+
+    if (source == nullptr) {
+        throw CompileError("Failed to find file: " + fileName +
+                           " in " + workingDir);
+    }
+
+    return source;
+}
+
+static string getModuleDir(ModuleGraph& graph, const string& workingDir,
+                           const string& filePath, bool libraryOnly)
+{
+    const string& libDir = graph.options.libDir;
+    string basePath;
+
+    if (!libraryOnly && graph.files.exists(workingDir + filePath)) {
+        basePath = workingDir + filePath;
+    } else {
+        if (!graph.files.exists(libDir + filePath)) {
+            throw CompileError("Failed to locate module: " + filePath + "\n" +
+                               "Working directory: " + workingDir + "\n" +
+                               "Library directory: " + libDir);
+        } else {
+            basePath = libDir + filePath;
+        }
+    }
+
+    size_t slash = basePath.find_last_of('/');
+
+    if (slash != string::npos) {
+        basePath = basePath.substr(0, slash+1);
+    } else {
+        basePath = "./";
+    }
+
+    return basePath;
+}
+
+// The whole program passes change the modules, so they are not shared
+static bool isLibraryModule(ModuleGraph& graph, const ModuleUnit& unit)
+{
+    const CompileOptions& options = graph.options;
+    return options.modules != nullptr &&
+           (!options.wholeProgram || !options.cacheDir.empty()) &&
+           !unit.isAssembly && unit.dir == options.libDir;
+}
+
+static string interfacePath(ModuleGraph& graph, const ModuleUnit& unit)
+{
+    Hash hash;
+    hash.add(unit.dir + unit.name);
+    return graph.options.cacheDir + hash.hex() + ".ui";
+}
+
+// Hashed the same way as a string of the same contents
+static void addSource(Hash& hash, const Source& source)
+{
+    hash.add((uint64_t)source.size());
+    hash.add(source.data(), source.size());
+}
+
+static uint64_t sourceHash(const ModuleUnit& unit)
+{
+    Hash hash;
+    addSource(hash, *unit.source);
+    return hash.value;
+}
+
+// Reads and parses every module reachable from the root. Imports are only
+// known once a module has been parsed, so the graph is loaded in waves and
+// the modules of each wave are parsed concurrently.
+static void loadModules(ModuleGraph& graph, size_t root)
+{
+    vector<size_t> wave(1, root);
+
+    while (!wave.empty()) {
+        parallelFor(wave.size(), [&](size_t i) {
+            ModuleUnit& unit = *graph.units[wave[i]];
+            PhaseTimer timer;
+            if (unit.isAssembly) {
+                unit.source.reset(readFile(graph, unit.dir, unit.name+".s"));
+            } else {
+                unit.source.reset(readFile(graph, unit.dir, unit.name+".u"));
+
+                if (isLibraryModule(graph, unit)) {
+                    unit.shared = graph.options.modules->find(
+                        unit.dir + unit.name, *unit.source);
+                    if (unit.shared != nullptr) {
+                        unit.ast = unit.shared->ast;
+                    }
+                }
+
+                // Imported modules that are unchanged since they were last
+                // compiled are loaded from their interface
+                if (unit.ast == nullptr && !graph.options.cacheDir.empty() &&
+                        wave[i] != root) {
+                    unit.ast.reset(readInterface(interfacePath(graph, unit),
+                                                 unit.name,
+                                                 sourceHash(unit),
+                                                 unit.interface));
+                    unit.fromInterface = unit.ast != nullptr;
+                }
+
+                unit.stats.reused = unit.ast != nullptr;
+                if (unit.ast == nullptr) {
+                    unit.ast.reset(parse(*unit.source, unit.name));
+                }
+            }
+            timer.stop(unit.stats.parse);
+        });
+
+        vector<size_t> nextWave;
+
+        for (size_t id : wave) {
+            ModuleUnit& unit = *graph.units[id];
+            if (unit.isAssembly) {
+                continue;
+            }
+
+            if (graph.options.astOutput != nullptr) {
+                *graph.options.astOutput << unit.ast->toString() << endl;
+            }
+
+            for (Import& import : unit.ast->imports) {
+                bool added;
+                size_t importId;
+
+                if (import.isAssembly) {
+                    importId = graph.find(unit.dir+import.path.str+".s",
+                                          unit.dir, import.path.str,
+                                          true, added);
+                } else {
+                    string name = getModuleName(import.path.str);
+                    string dir = getModuleDir(graph, unit.dir,
+                                              import.path.str+".u",
+                                              import.isLibrary);
+                    importId = graph.find(dir+name, dir, name, false, added);
+                }
+
+                if (added) {
+                    nextWave.push_back(importId);
+                }
+                unit.imports.push_back(importId);
+            }
+        }
+
+        wave = move(nextWave);
+    }
+}
+
+static void sortModules(ModuleGraph& graph, size_t id, vector<int>& marks)
+{
+    enum {UNVISITED, VISITING, DONE};
+
+    if (marks[id] == DONE) {
+        return;
+    }
+
+    if (marks[id] == VISITING) {
+        throw CompileError("Circular import of module: " +
+                           graph.units[id]->name);
+    }
+
+    marks[id] = VISITING;
+    for (size_t importId : graph.units[id]->imports) {
+        if (!graph.units[importId]->isAssembly) {
+            sortModules(graph, importId, marks);
+        }
+    }
+    marks[id] = DONE;
+
+    // Functions are named after their module, two modules of the same name
+    // from different directories can't be told apart
+    ModuleUnit& unit = *graph.units[id];
+    auto named = graph.byName.find(unit.name);
+    if (named != graph.byName.end()) {
+        throw CompileError("Module " + unit.name + " is imported from both " +
+                           graph.units[named->second]->dir + " and " +
+                           unit.dir);
+    }
+
+    graph.order.push_back(id);
+    graph.byName[unit.name] = id;
+}
+
+// Writes the generated code in the same order as a depth first walk of the
+// imports, every module and assembly file is written once
+static void writeAssembly(ModuleGraph& graph, size_t id,
+                          vector<bool>& written, CodeBuffer& out)
+{
+    ModuleUnit& unit = *graph.units[id];
+
+    for (size_t i = 0; i < unit.imports.size(); i++) {
+        size_t importId = unit.imports[i];
+        if (written[importId]) {
+            continue;
+        }
+        written[importId] = true;
+        if (!graph.units[importId]->needed) {
+            continue;
+        }
+        out << ";; " << unit.ast->imports[i].path.str << " ;;\n";
+
+        if (graph.units[importId]->isAssembly) {
+            const Source& source = *graph.units[importId]->source;
+            out.append(source.data(), source.size());
+            out << "\n";
+        } else {
+            writeAssembly(graph, importId, written, out);
+        }
+    }
+
+    out << unit.assembly;
+}
+
+//
+// Object cache
+//
+// With a cache directory every module and assembly import is assembled into
+// its own object, stored in the cache directory under a hash of everything
+// its code depends on. Objects found in the cache are linked without
+// generating or assembling them again.
+//
+
+// Bump this when the generated code changes so stale objects are not reused
+static const uint64_t OBJECT_CACHE_VERSION = 2;
+
+static string objectPath(ModuleGraph& graph, uint64_t key)
+{
+    Hash hash;
+    hash.value = key;
+    return graph.options.cacheDir + hash.hex() + ".o";
+}
+
+// Hash of the function signatures a module exposes to its callers
+static uint64_t interfaceHash(ModuleNode* ast)
+{
+    Hash hash;
+    for (FunctionNode* function : ast->functions) {
+        hash.add(function->id.str());
+        hash.add(function->returnType->toString());
+        for (Declaration* argument : function->arguments) {
+            hash.add(argument->type->toString());
+        }
+    }
+    return hash.value;
+}
+
+// Functions generated for a module are visible to other objects, everything
+// they call that is defined elsewhere is external
+static string linkageDirectives(ModuleNode* ast, const vector<bool>& live)
+{
+    set<string> globals;
+    set<string> externs;
+
+    for (size_t i = 0; i < ast->functions.size(); i++) {
+        if (ast->functions[i]->block != nullptr &&
+                (live.empty() || live[i])) {
+            globals.insert(ast->functions[i]->id.asmString());
+        }
+    }
+
+    for (size_t i = 0; i < ast->functions.size(); i++) {
+        if (!live.empty() && !live[i]) {
+            continue;
+        }
+        for (FunctionNode* callee : ast->functions[i]->callees) {
+            if (globals.find(callee->id.asmString()) == globals.end()) {
+                externs.insert(callee->id.asmString());
+            }
+        }
+    }
+
+    string directives;
+    for (const string& name : globals) {
+        directives += "global " + name + "\n";
+    }
+    for (const string& name : externs) {
+        directives += "extern " + name + "\n";
+    }
+    return directives;
+}
+
+// Assembles the code into the cache under its key, going through temporary
+// files so that concurrent compilers sharing the cache never see partial
+// objects
+static void storeObject(const string& code, const string& object,
+                        PhaseTime& time)
+{
+    string temp = temporaryPath(object);
+
+    ofstream out((temp + ".s").c_str(), ios::trunc);
+    if (!out) {
+        throw CompileError("Failed to write to cache: " + temp + ".s");
+    }
+    out << code;
+    out.close();
+
+    assembleFile(temp + ".s", temp + ".o", time);
+
+    unlink((temp + ".s").c_str());
+    if (rename((temp + ".o").c_str(), object.c_str()) != 0) {
+        throw CompileError(systemError("Failed to store object in cache: "));
+    }
+}
+
+static set<string> calledModules(const ModuleUnit& unit)
+{
+    if (unit.fromInterface) {
+        return set<string>(unit.interface.calledModules.begin(),
+                           unit.interface.calledModules.end());
+    }
+
+    set<string> modules;
+    for (FunctionNode* function : unit.ast->functions) {
+        for (FunctionNode* callee : function->callees) {
+            modules.insert(callee->id.moduleString());
+        }
+    }
+    return modules;
+}
+
+// Interface hashes of the modules and the functions implemented by each
+// assembly import, which are the extern functions declared by its importers
+static void computeInterfaces(ModuleGraph& graph)
+{
+    for (size_t id : graph.order) {
+        ModuleUnit& unit = *graph.units[id];
+
+        if (unit.fromInterface) {
+            unit.interfaceHash = unit.interface.interfaceHash;
+        } else {
+            unit.interfaceHash = interfaceHash(unit.ast.get());
+        }
+
+        for (size_t importId : unit.imports) {
+            ModuleUnit& imported = *graph.units[importId];
+            if (!imported.isAssembly) {
+                continue;
+            }
+
+            if (unit.fromInterface) {
+                imported.asmGlobals.insert(
+                    unit.interface.externFunctions.begin(),
+                    unit.interface.externFunctions.end());
+                continue;
+            }
+
+            for (FunctionNode* function : unit.ast->functions) {
+                if (function->block == nullptr) {
+                    imported.asmGlobals.insert(function->id.asmString());
+                }
+            }
+        }
+    }
+}
+
+// Hash of everything the object of a unit depends on. For modules this
+// includes the interfaces of the modules they were validated against, the
+// callees are only known after validation or from the interface file.
+static uint64_t objectKey(ModuleGraph& graph, ModuleUnit& unit)
+{
+    Hash key;
+
+    key.add(OBJECT_CACHE_VERSION);
+    key.add((uint64_t)graph.options.eliminateTailCalls);
+    key.add((uint64_t)graph.options.dataAlignment);
+    key.add(unit.dir + unit.name);
+    addSource(key, *unit.source);
+
+    if (unit.isAssembly) {
+        for (const string& name : unit.asmGlobals) {
+            key.add(name);
+        }
+        return key.value;
+    }
+
+    for (size_t importId : unit.imports) {
+        key.add(graph.units[importId]->interfaceHash);
+    }
+
+    // Functions can be called without importing their module directly, so
+    // every module called into is part of the key
+    for (const string& name : calledModules(unit)) {
+        auto itr = graph.byName.find(name);
+        if (itr != graph.byName.end()) {
+            key.add(graph.units[itr->second]->interfaceHash);
+        }
+    }
+
+    return key.value;
+}
+
+// A module loaded from its interface is only used if it would still compile
+// to its cached object, otherwise it is parsed and validated normally
+static void reuseInterfaces(ModuleGraph& graph)
+{
+    computeInterfaces(graph);
+
+    vector<size_t> stale;
+
+    for (size_t id : graph.order) {
+        ModuleUnit& unit = *graph.units[id];
+        if (!unit.fromInterface) {
+            continue;
+        }
+
+        uint64_t key = objectKey(graph, unit);
+        if (key != unit.interface.objectKey ||
+                access(objectPath(graph, key).c_str(), R_OK) != 0) {
+            stale.push_back(id);
+        }
+    }
+
+    parallelFor(stale.size(), [&](size_t i) {
+        ModuleUnit& unit = *graph.units[stale[i]];
+        unit.ast.reset(parse(*unit.source, unit.name));
+        unit.fromInterface = false;
+    });
+}
+
+// A shared module can be used if every call in it resolves to the same
+// function it did when the module was validated. Its functions are then
+// declared without validating it again.
+static bool declareShared(ModuleNode* ast, SymbolTable& symbols)
+{
+    for (FunctionNode* function : ast->functions) {
+        if (symbols.getFunction(function->id) != nullptr) {
+            return false;
+        }
+        for (FunctionNode* callee : function->callees) {
+            if (callee->id.moduleString() != ast->name &&
+                    symbols.getFunction(callee->id) != callee) {
+                return false;
+            }
+        }
+    }
+
+    for (FunctionNode* function : ast->functions) {
+        symbols.setFunction(function->id, function);
+    }
+    return true;
+}
+
+// A library module is shared once validated if everything it calls is
+static void shareModule(ModuleGraph& graph, ModuleUnit& unit)
+{
+    for (FunctionNode* function : unit.ast->functions) {
+        for (FunctionNode* callee : function->callees) {
+            ModuleUnit& owner =
+                *graph.units[graph.byName[callee->id.moduleString()]];
+            if (&owner != &unit && owner.shared == nullptr) {
+                return;
+            }
+        }
+    }
+
+    shared_ptr<SharedModule> shared(new SharedModule());
+    shared->source.reset(Source::copy(string(unit.source->data(),
+                                             unit.source->size())));
+    shared->ast = unit.ast;
+
+    if (graph.options.modules->add(unit.dir + unit.name, shared)) {
+        unit.shared = shared;
+    }
+}
+
+// Code of a shared module is generated once for each code generation
+// option, function by function so every program can take the ones it uses
+static const vector<string>& sharedFunctions(SharedModule& shared,
+                                             const CompileOptions& options)
+{
+    int variant = options.eliminateTailCalls;
+
+    lock_guard<mutex> guard(shared.lock);
+    if (!shared.generated[variant]) {
+        vector<CodeBuffer> buffers;
+        shared.ast->cgenFunctions(buffers, options, vector<bool>());
+        for (CodeBuffer& buffer : buffers) {
+            shared.functions[variant].push_back(buffer.release());
+        }
+        shared.generated[variant] = true;
+    }
+    return shared.functions[variant];
+}
+
+static void generateUnit(ModuleUnit& unit, const CompileOptions& options)
+{
+    if (unit.generated || unit.isAssembly) {
+        return;
+    }
+
+    PhaseTimer timer;
+    if (unit.shared != nullptr) {
+        // Laid out the same way as ModuleNode::cgen
+        const vector<string>& functions = sharedFunctions(*unit.shared,
+                                                          options);
+        unit.assembly << "section .text\n\n";
+        for (size_t i = 0; i < functions.size(); i++) {
+            if (unit.live.empty() || unit.live[i]) {
+                unit.assembly << functions[i];
+            }
+        }
+        unit.ast->cgenData(unit.assembly, options);
+    } else {
+        unit.ast->cgen(unit.assembly, options, unit.live);
+    }
+    unit.generated = true;
+    timer.stop(unit.stats.cgen);
+}
+
+// The code of a unit assembled into an object of its own
+static void objectCode(ModuleUnit& unit, CodeBuffer& code)
+{
+    if (unit.isAssembly) {
+        for (const string& name : unit.asmGlobals) {
+            code << "global " << name << "\n";
+        }
+        // Defined by the start code, see startAsm
+        code << "extern _exit, _atexit, _unbuffered\n";
+        code.append(unit.source->data(), unit.source->size());
+        code << "\n";
+    } else {
+        code << linkageDirectives(unit.ast.get(), unit.live);
+        code << unit.assembly;
+    }
+}
+
+// Code of the object calling the main function of the program
+static void startCode(const string& moduleName, CodeBuffer& code,
+                      const CompileOptions& options)
+{
+    code << "extern " << moduleName << ".main\n";
+    startAsm(code, moduleName, options.unbuffered);
+}
+
+// Declares the functions of a shared module, returns false if it has to be
+// validated. A shared module that doesn't fit the program is parsed again.
+static bool declareUnit(ModuleUnit& unit, SymbolTable& symbols)
+{
+    if (unit.shared == nullptr) {
+        return false;
+    }
+    if (declareShared(unit.ast.get(), symbols)) {
+        return true;
+    }
+    unit.shared.reset();
+    unit.ast.reset(parse(*unit.source, unit.name));
+    unit.stats.reused = false;
+    return false;
+}
+
+// Validation fills in the shared symbol table, so it is done in order
+static void validateModules(ModuleGraph& graph, SymbolTable& symbols)
+{
+    for (size_t id : graph.order) {
+        ModuleUnit& unit = *graph.units[id];
+        PhaseTimer timer;
+
+        if (declareUnit(unit, symbols)) {
+            timer.stop(unit.stats.validate);
+            continue;
+        }
+
+        vector<Diagnostic> errors = unit.ast->validate(symbols, *unit.source);
+
+        if (!errors.empty()) {
+            timer.stop(unit.stats.validate);
+            throw CompileError(errors);
+        }
+
+        if (isLibraryModule(graph, unit) && !unit.fromInterface) {
+            shareModule(graph, unit);
+        }
+        timer.stop(unit.stats.validate);
+    }
+}
+
+// Validates the signatures of every module, but of the imported modules
+// only the bodies of functions the root module reaches, following calls as
+// they are validated. Partly validated modules are not shared.
+static void validateReachable(ModuleGraph& graph, size_t root,
+                              SymbolTable& symbols)
+{
+    vector<unique_ptr<ErrorCollector>> errors(graph.units.size());
+    vector<FunctionNode*> pending;
+    set<FunctionNode*> unreached;
+
+    for (size_t id : graph.order) {
+        ModuleUnit& unit = *graph.units[id];
+        PhaseTimer timer;
+
+        if (!declareUnit(unit, symbols)) {
+            errors[id].reset(new ErrorCollector(*unit.source,
+                                                unit.name + ".u"));
+            unit.ast->validateSignatures(symbols, *errors[id]);
+
+            for (FunctionNode* function : unit.ast->functions) {
+                if (id == root) {
+                    pending.push_back(function);
+                } else {
+                    unreached.insert(function);
+                }
+            }
+        }
+        timer.stop(unit.stats.validate);
+    }
+
+    for (size_t next = 0; next < pending.size(); next++) {
+        FunctionNode* function = pending[next];
+        size_t id = graph.byName[function->id.moduleString()];
+        ModuleUnit& unit = *graph.units[id];
+
+        PhaseTimer timer;
+        unit.ast->validateBody(function, symbols, *errors[id]);
+        timer.stop(unit.stats.validate);
+
+        for (FunctionNode* callee : function->callees) {
+            if (unreached.erase(callee) != 0) {
+                pending.push_back(callee);
+            }
+        }
+    }
+
+    for (FunctionNode* function : unreached) {
+        if (function->block != nullptr) {
+            graph.units[graph.byName[function->id.moduleString()]]->partial =
+                true;
+        }
+    }
+
+    vector<Diagnostic> diagnostics;
+    for (size_t id : graph.order) {
+        if (errors[id] != nullptr) {
+            const vector<Diagnostic>& found = errors[id]->getDiagnostics();
+            diagnostics.insert(diagnostics.end(), found.begin(), found.end());
+        }
+    }
+    if (!diagnostics.empty()) {
+        throw CompileError(diagnostics);
+    }
+
+    for (size_t id : graph.order) {
+        ModuleUnit& unit = *graph.units[id];
+        if (errors[id] != nullptr && !unit.partial &&
+                isLibraryModule(graph, unit) && !unit.fromInterface) {
+            shareModule(graph, unit);
+        }
+    }
+}
+
+static FunctionNode* findMain(ModuleNode* ast)
+{
+    for (FunctionNode* function : ast->functions) {
+        if (function->id.str() == "main") {
+            return function;
+        }
+    }
+    return nullptr;
+}
+
+// Marks the functions main reaches through calls, only those are
+// generated. An assembly import is needed if one of the functions it
+// implements is reached, those are declared extern by its importers.
+static void markLive(ModuleGraph& graph, FunctionNode* main)
+{
+    unordered_map<FunctionNode*, pair<size_t, size_t>> places;
+    vector<FunctionNode*> pending(1, main);
+
+    for (size_t id : graph.order) {
+        ModuleNode* ast = graph.units[id]->ast.get();
+        graph.units[id]->live.assign(ast->functions.size(), false);
+        for (size_t i = 0; i < ast->functions.size(); i++) {
+            places[ast->functions[i]] = make_pair(id, i);
+        }
+    }
+
+    while (!pending.empty()) {
+        FunctionNode* function = pending.back();
+        pending.pop_back();
+
+        auto itr = places.find(function);
+        if (itr == places.end()) {
+            continue;
+        }
+        vector<bool>& live = graph.units[itr->second.first]->live;
+        if (live[itr->second.second]) {
+            continue;
+        }
+        live[itr->second.second] = true;
+
+        pending.insert(pending.end(), function->callees.begin(),
+                       function->callees.end());
+    }
+
+    for (const unique_ptr<ModuleUnit>& unit : graph.units) {
+        unit->needed = !unit->isAssembly;
+    }
+
+    for (size_t id : graph.order) {
+        ModuleUnit& unit = *graph.units[id];
+        for (size_t importId : unit.imports) {
+            ModuleUnit& imported = *graph.units[importId];
+            if (!imported.isAssembly) {
+                continue;
+            }
+            for (size_t i = 0; i < unit.ast->functions.size(); i++) {
+                if (unit.ast->functions[i]->block == nullptr &&
+                        unit.live[i]) {
+                    imported.needed = true;
+                }
+            }
+        }
+    }
+}
+
+static void compileModules(ModuleGraph& graph, const string& workingDir,
+                           const string& moduleName, SymbolTable& symbols,
+                           CompileStats& timing)
+{
+    bool added;
+
+    size_t root = graph.find(workingDir+moduleName, workingDir, moduleName,
+                             false, added);
+
+    PhaseTimer loadTimer;
+    loadModules(graph, root);
+
+    vector<int> marks(graph.units.size(), 0);
+    sortModules(graph, root, marks);
+
+    if (!graph.options.cacheDir.empty()) {
+        reuseInterfaces(graph);
+    }
+    loadTimer.stop(timing.load);
+
+    PhaseTimer validateTimer;
+    try {
+        if (graph.options.skipUnreachable && graph.options.cacheDir.empty()) {
+            validateReachable(graph, root, symbols);
+        } else {
+            validateModules(graph, symbols);
+        }
+    } catch (CompileError&) {
+        validateTimer.stop(timing.validate);
+        throw;
+    }
+    validateTimer.stop(timing.validate);
+
+    // Cached objects hold whole modules. Without a main the program
+    // doesn't link, it is left whole.
+    FunctionNode* main = findMain(graph.units[root]->ast.get());
+    if (!graph.options.cacheDir.empty() || main == nullptr) {
+        return;
+    }
+
+    if (graph.options.wholeProgram) {
+        PhaseTimer optimizeTimer;
+        vector<ModuleNode*> modules;
+        for (size_t id : graph.order) {
+            if (!graph.units[id]->isAssembly) {
+                modules.push_back(graph.units[id]->ast.get());
+            }
+        }
+        optimizeProgram(modules, main, timing.optimizer);
+        optimizeTimer.stop(timing.optimize);
+    }
+
+    markLive(graph, main);
+}
+
+struct NodeCounter : Visitor<NodeCounter> {
+    ModuleStats& stats;
+
+    NodeCounter(ModuleStats& stats) : stats(stats) {}
+
+    void visitFunction(FunctionNode* function) {
+        stats.functions++;
+        Visitor::visitFunction(function);
+    }
+
+    void visit(Statement* statement) {
+        stats.statements++;
+        Visitor::visit(statement);
+    }
+
+    void visit(Expression*& expr) {
+        stats.expressions++;
+        Visitor::visit(expr);
+    }
+};
+
+CompilerSession::CompilerSession(const CompileOptions& options,
+                                 FileSystem& files)
+    : options(options), files(files),
+      graph(new ModuleGraph(this->options, files))
+{
+}
+
+CompilerSession::~CompilerSession()
+{
+}
+
+bool CompilerSession::compile(const string& path, const string& workingDir)
+{
+    try {
+        if (!graph->units.empty()) {
+            throw CompileError("A session can only compile once");
+        }
+
+        moduleName = getModuleName(path);
+        moduleName = moduleName.substr(0, moduleName.length()-2);
+
+        string dir = getModuleDir(*graph, workingDir, path, false);
+        compileModules(*graph, dir, moduleName, symbols, timing);
+
+        if (!options.cacheDir.empty()) {
+            if (mkdir(options.cacheDir.c_str(), 0755) != 0 &&
+                    errno != EEXIST) {
+                throw CompileError(
+                    systemError("Failed to create cache directory: "));
+            }
+            writeObjects();
+        }
+    } catch (CompileError& error) {
+        diagnostics.insert(diagnostics.end(), error.diagnostics.begin(),
+                           error.diagnostics.end());
+        return false;
+    }
+
+    compiled = true;
+    return true;
+}
+
+void CompilerSession::generate()
+{
+    PhaseTimer timer;
+    CodeBuffer out;
+
+    startAsm(out, moduleName, options.unbuffered);
+
+    parallelFor(graph->order.size(), [&](size_t i) {
+        generateUnit(*graph->units[graph->order[i]], options);
+    });
+
+    size_t root = graph->order.back();
+    vector<bool> written(graph->units.size(), false);
+    written[root] = true;
+    writeAssembly(*graph, root, written, out);
+
+    code = out.release();
+    timer.stop(timing.generate);
+}
+
+// Every unit is generated and assembled by the same worker, so the
+// assembler runs on some modules while the code of others is still being
+// generated. Nothing is written to disk, the code and the objects are kept
+// in memory files.
+void CompilerSession::assembleModules()
+{
+    PhaseTimer timer;
+    size_t unitCount = graph->units.size();
+
+    computeInterfaces(*graph);
+
+    memoryObjects.resize(unitCount+1);
+
+    parallelFor(unitCount+1, [&](size_t i) {
+        CodeBuffer code;
+        PhaseTime startTime;
+        PhaseTime& assembleTime = i == unitCount ?
+            startTime : graph->units[i]->stats.assemble;
+
+        if (i == unitCount) {
+            startCode(moduleName, code, options);
+        } else if (!graph->units[i]->needed) {
+            return;
+        } else {
+            generateUnit(*graph->units[i], options);
+            objectCode(*graph->units[i], code);
+        }
+
+        MemoryFile source;
+        source.write(code.str());
+
+        unique_ptr<MemoryFile> object(new MemoryFile());
+        assembleFile(source.path, object->path, assembleTime);
+        memoryObjects[i] = move(object);
+    });
+
+    timer.stop(timing.generate);
+
+    objects.push_back(memoryObjects[unitCount]->path);
+    for (size_t id = 0; id < unitCount; id++) {
+        if (memoryObjects[id] != nullptr) {
+            objects.push_back(memoryObjects[id]->path);
+        }
+    }
+}
+
+void CompilerSession::writeObjects()
+{
+    PhaseTimer timer;
+    size_t unitCount = graph->units.size();
+
+    computeInterfaces(*graph);
+
+    objects.assign(unitCount, string());
+    vector<uint64_t> keys(unitCount);
+    vector<size_t> misses;
+
+    for (size_t id = 0; id < unitCount; id++) {
+        keys[id] = objectKey(*graph, *graph->units[id]);
+        objects[id] = objectPath(*graph, keys[id]);
+        if (graph->units[id]->fromInterface) {
+            stats.interfaces++;
+        } else if (access(objects[id].c_str(), R_OK) != 0) {
+            misses.push_back(id);
+        }
+    }
+
+    parallelFor(misses.size(), [&](size_t i) {
+        ModuleUnit& unit = *graph->units[misses[i]];
+        CodeBuffer code;
+
+        generateUnit(unit, options);
+        objectCode(unit, code);
+
+        storeObject(code.str(), objects[misses[i]], unit.stats.assemble);
+    });
+
+    // Interfaces are written once the objects they refer to exist
+    for (size_t id : graph->order) {
+        ModuleUnit& unit = *graph->units[id];
+        if (unit.fromInterface) {
+            continue;
+        }
+
+        InterfaceInfo info;
+        info.sourceHash = sourceHash(unit);
+        info.interfaceHash = unit.interfaceHash;
+        info.objectKey = keys[id];
+
+        set<string> modules = calledModules(unit);
+        info.calledModules.assign(modules.begin(), modules.end());
+
+        for (FunctionNode* function : unit.ast->functions) {
+            if (function->block == nullptr) {
+                info.externFunctions.push_back(function->id.asmString());
+            }
+        }
+
+        writeInterface(interfacePath(*graph, unit), unit.ast.get(), info);
+    }
+
+    Hash startKey;
+    startKey.add(OBJECT_CACHE_VERSION);
+    startKey.add(moduleName);
+    startKey.add((uint64_t)options.unbuffered);
+    string startObject = options.cacheDir + "start-" + startKey.hex() + ".o";
+
+    if (access(startObject.c_str(), R_OK) != 0) {
+        CodeBuffer code;
+        PhaseTime startTime;
+        startCode(moduleName, code, options);
+        storeObject(code.str(), startObject, startTime);
+    }
+
+    objects.insert(objects.begin(), startObject);
+
+    stats.hits = unitCount - misses.size();
+    stats.misses = misses.size();
+
+    timer.stop(timing.generate);
+}
+
+const string& CompilerSession::getAssembly()
+{
+    if (compiled && options.cacheDir.empty() && code.empty()) {
+        generate();
+    }
+    return code;
+}
+
+bool CompilerSession::assemble(string& object)
+{
+    if (!compiled) {
+        return false;
+    }
+
+    try {
+        if (objects.empty()) {
+            assembleModules();
+        }
+
+        // The objects of the modules are combined into one
+        MemoryFile output;
+        vector<string> args = {"ld", "-r", "-o", output.path};
+        args.insert(args.end(), objects.begin(), objects.end());
+        runTool(args, "Link failed.", timing.link);
+
+        object = output.read();
+    } catch (CompileError& error) {
+        diagnostics.insert(diagnostics.end(), error.diagnostics.begin(),
+                           error.diagnostics.end());
+        return false;
+    }
+
+    return true;
+}
+
+bool CompilerSession::link(const string& output)
+{
+    if (!compiled) {
+        return false;
+    }
+
+    try {
+        if (objects.empty()) {
+            assembleModules();
+        }
+        linkObjects(objects, output, timing.link);
+    } catch (CompileError& error) {
+        diagnostics.insert(diagnostics.end(), error.diagnostics.begin(),
+                           error.diagnostics.end());
+        return false;
+    }
+
+    return true;
+}
+
+const vector<Diagnostic>& CompilerSession::getDiagnostics() const
+{
+    return diagnostics;
+}
+
+const CacheStats& CompilerSession::getCacheStats() const
+{
+    return stats;
+}
+
+CompileStats CompilerSession::getStats() const
+{
+    CompileStats result = timing;
+
+    // The phases are timed on this thread, their modules on many
+    result.load.cpu = 0;
+    result.validate.cpu = 0;
+    result.generate.cpu = 0;
+
+    for (const unique_ptr<ModuleUnit>& unit : graph->units) {
+        ModuleStats module = unit->stats;
+        module.name = unit->name;
+        module.isAssembly = unit->isAssembly;
+
+        if (unit->isAssembly) {
+            module.assemblyBytes = unit->source && unit->needed ?
+                unit->source->size() : 0;
+        } else {
+            module.assemblyBytes = unit->assembly.size();
+        }
+
+        if (unit->ast != nullptr) {
+            NodeCounter(module).visitModule(unit->ast.get());
+        }
+
+        result.load.cpu += module.parse.cpu;
+        result.validate.cpu += module.validate.cpu;
+        result.generate.cpu += module.cgen.cpu + module.assemble.cpu;
+        result.assemblyBytes += module.assemblyBytes;
+        result.modules.push_back(module);
+    }
+
+    result.symbolFunctions = symbols.getFunctionCount();
+    result.symbolPeakVariables = symbols.getPeakVariableCount();
+
+    result.peakRSS = peakRSS();
+
+    return result;
+}
@@ -0,0 +1,149 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Diagnostic.h"
+#include "Source.h"
+#include "Stats.h"
+#include "SymbolTable.h"
+
+using namespace std;
+
+//
+// Library interface of the compiler. A CompilerSession compiles one program,
+// any number of sessions may run at the same time on different threads.
+// Parallel phases of all sessions share the thread budget of Flags::jobs.
+//
+
+// Where sources are read from. Paths are joined as plain strings, so
+// directories end in '/'. Files may be read from several threads at once.
+class FileSystem {
+public:
+    virtual ~FileSystem() {}
+    virtual bool exists(const string& path) = 0;
+    // Returns a new Source owned by the caller, nullptr if the file can't
+    // be read
+    virtual Source* readFile(const string& path) = 0;
+};
+
+// Files are mapped, the page cache holds their contents between sessions
+class DiskFileSystem : public FileSystem {
+public:
+    bool exists(const string& path);
+    Source* readFile(const string& path);
+};
+
+// Sources held in memory, paths must match exactly
+class MemoryFileSystem : public FileSystem {
+private:
+    map<string,string> files;
+public:
+    void addFile(const string& path, const string& contents);
+    bool exists(const string& path);
+    Source* readFile(const string& path);
+};
+
+struct SharedModule;
+
+// Library modules that have been parsed, validated and generated, shared by
+// all sessions using the cache. A module is reused as long as its source is
+// unchanged and everything it calls is shared as well.
+class ModuleCache {
+private:
+    mutex lock;
+    unordered_map<string, shared_ptr<SharedModule>> modules;
+public:
+    shared_ptr<SharedModule> find(const string& path, const Source& source);
+    // Returns false if the module was added by another session first
+    bool add(const string& path, const shared_ptr<SharedModule>& module);
+};
+
+struct CompileOptions {
+    bool eliminateTailCalls = false;
+    // Directory searched for imports that aren't found next to the importer
+    string libDir;
+    // With a cache directory every module is assembled into its own object
+    // there, and modules that haven't changed are not compiled again
+    string cacheDir;
+    // If set, the AST of every parsed module is printed to it
+    ostream* astOutput = nullptr;
+    // If set, modules in libDir are taken from and added to it
+    ModuleCache* modules = nullptr;
+    // If set, the bodies of imported functions that main can't reach are not
+    // validated. Ignored with a cache directory, cached objects hold whole
+    // modules.
+    bool skipUnreachable = false;
+    // Run the interprocedural passes of Optimize.h on the whole program
+    // before generating it. Library modules are then not shared between
+    // programs. Ignored with a cache directory.
+    bool wholeProgram = false;
+    // Globals start at a multiple of it, 64 puts every one of them at the
+    // start of a cache line
+    int dataAlignment = 8;
+    // Output of lib/io is written right away instead of being buffered
+    // until the buffer is full or the program exits
+    bool unbuffered = false;
+};
+
+struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t interfaces = 0;
+};
+
+struct ModuleGraph;
+struct MemoryFile;
+
+class CompilerSession {
+private:
+    CompileOptions options;
+    FileSystem& files;
+    SymbolTable symbols;
+    unique_ptr<ModuleGraph> graph;
+    string moduleName;
+    string code;
+    vector<string> objects;
+    vector<unique_ptr<MemoryFile>> memoryObjects;
+    vector<Diagnostic> diagnostics;
+    CacheStats stats;
+    CompileStats timing;
+    bool compiled = false;
+
+    void generate();
+    void assembleModules();
+    void writeObjects();
+public:
+    CompilerSession(const CompileOptions& options, FileSystem& files);
+    ~CompilerSession();
+
+    // Loads the module at workingDir + path and every module it imports and
+    // validates them. Returns false if compilation failed, the reasons are in
+    // getDiagnostics(). A session compiles once. Without a cache the code is
+    // generated when it is first needed by one of the functions below.
+    bool compile(const string& path, const string& workingDir = "");
+
+    // The assembly of the whole program, empty when a cache is used
+    const string& getAssembly();
+
+    // Assembles the program into a single object, returned in object
+    bool assemble(string& object);
+
+    // Assembles and links the program into an executable. Every module is
+    // assembled into an object of its own as soon as its code is generated,
+    // in memory unless a cache is used.
+    bool link(const string& output);
+
+    const vector<Diagnostic>& getDiagnostics() const;
+    const CacheStats& getCacheStats() const;
+    // Time spent in each phase and module, sizes of what was compiled
+    CompileStats getStats() const;
+};
+
+#endif
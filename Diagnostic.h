@@ -0,0 +1,36 @@
+#ifndef DIAGNOSTIC_H
+#define DIAGNOSTIC_H
+
+#include <string>
+#include <vector>
+using namespace std;
+
+// An error found while compiling. Errors that aren't tied to a place in a
+// source file have an empty file name and line 0.
+struct Diagnostic {
+    string file;
+    int line = 0;
+    int column = 0;
+    string message;
+    string sourceLine;
+
+    // Formatted the way the command line compiler prints it
+    string toString() const;
+};
+
+// Thrown by the compiler when it can't continue, CompilerSession turns it
+// into the diagnostics of the compilation
+struct CompileError {
+    vector<Diagnostic> diagnostics;
+
+    CompileError(const string& message) {
+        Diagnostic diagnostic;
+        diagnostic.message = message;
+        diagnostics.push_back(diagnostic);
+    }
+    CompileError(const vector<Diagnostic>& diagnostics) {
+        this->diagnostics = diagnostics;
+    }
+};
+
+#endif
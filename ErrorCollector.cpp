@@ -1,54 +1,80 @@
 #include "ErrorCollector.h"
 using namespace std;
 
-ErrorCollector::ErrorCollector(char** sourceLines, const string& fileName)
+string Diagnostic::toString() const
+{
+    if (line == 0) {
+        return message + "\n";
+    }
+
+    return file + " " + to_string(line) + ":" + to_string(column) + " " +
+           message + "\n" + "    " + sourceLine + "\n\n";
+}
+
+ErrorCollector::ErrorCollector(const Source& source, const string& fileName)
+    : source(source)
 {
-    this->sourceLines = sourceLines;
     this->fileName = fileName;
 }
 
-string ErrorCollector::getErrorString() const
+string ErrorCollector::getLine(int line)
 {
-    return errors.str();
+    if (lineStarts.empty()) {
+        lineStarts.push_back(0);
+        for (size_t i = 0; i < source.size(); i++) {
+            if (source.data()[i] == '\n') {
+                lineStarts.push_back(i+1);
+            }
+        }
+    }
+
+    if (line < 0 || (size_t)line >= lineStarts.size()) {
+        return "";
+    }
+
+    size_t index = line;
+    size_t start = lineStarts[index];
+    size_t end = source.size();
+    if (index+1 < lineStarts.size()) {
+        end = lineStarts[index+1] - 1;
+    }
+    return string(source.data() + start, end - start);
 }
 
-void ErrorCollector::putLoc(SourceLocation location)
+const vector<Diagnostic>& ErrorCollector::getDiagnostics() const
 {
-    errors << fileName << " ";
-    errors << location.line+1 << ":" << location.column << " ";
+    return diagnostics;
 }
 
-void ErrorCollector::putLine(SourceLocation location)
+void ErrorCollector::add(SourceLocation location, const string& message)
 {
-    errors << "    " << sourceLines[location.line] << "\n\n";
+    Diagnostic diagnostic;
+    diagnostic.file = fileName;
+    diagnostic.line = location.line+1;
+    diagnostic.column = location.column;
+    diagnostic.message = message;
+    diagnostic.sourceLine = getLine(location.line);
+    diagnostics.push_back(diagnostic);
 }
 
 void ErrorCollector::error(SourceLocation location, string message)
 {
-    putLoc(location);
-    errors << message << "\n";
-    putLine(location);
+    add(location, message);
 }
 
 void ErrorCollector::undefinedVariable(SourceLocation location, string id)
 {
-    putLoc(location);
-    errors << "Reference to undefined variable: " << id << "\n";
-    putLine(location);
+    add(location, "Reference to undefined variable: " + id);
 }
 
 void ErrorCollector::undefinedFunction(SourceLocation location, string id)
 {
-    putLoc(location);
-    errors << "Reference to undefined function: " << id << "\n";
-    putLine(location);
+    add(location, "Reference to undefined function: " + id);
 }
 
 void ErrorCollector::unexpectedType(SourceLocation location,
                                     Type* expected, Type* found)
 {
-    putLoc(location);
-    errors << "Expected expression of type '" << expected->toString();
-    errors << "', found '" << found->toString() << "' \n";
-    putLine(location);
+    add(location, "Expected expression of type '" + expected->toString() +
+                  "', found '" + found->toString() + "' ");
 }
@@ -2,25 +2,30 @@
 #define ERROR_COLLECTOR
 
 #include <string>
-#include <sstream>
+#include <vector>
+#include "Diagnostic.h"
+#include "Source.h"
 #include "SourceLocation.h"
 #include "Type.h"
 using namespace std;
 
 class ErrorCollector {
 private:
-    ostringstream errors;
-    char** sourceLines;
+    vector<Diagnostic> diagnostics;
+    const Source& source;
     string fileName;
-    void putLoc(SourceLocation);
-    void putLine(SourceLocation);
+    // Offsets of the line starts in source, built when the first error is
+    // reported
+    vector<size_t> lineStarts;
+    string getLine(int line);
+    void add(SourceLocation, const string&);
 public:
-    ErrorCollector(char** sourceLines, const string& fileName);
+    ErrorCollector(const Source& source, const string& fileName);
     void error(SourceLocation, string);
     void undefinedVariable(SourceLocation, string);
     void undefinedFunction(SourceLocation, string);
     void unexpectedType(SourceLocation, Type*, Type*);
-    string getErrorString() const;
+    const vector<Diagnostic>& getDiagnostics() const;
 };
 
 #endif
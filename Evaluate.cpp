@@ -0,0 +1,281 @@
+#include <unordered_map>
+#include <limits.h>
+#include <assert.h>
+
+#include "Evaluate.h"
+
+using namespace std;
+
+// Statements and expressions one evaluation may go through
+static const size_t MAX_STEPS = 1000000;
+// Calls that may be in progress at once, counting the first one
+static const size_t MAX_DEPTH = 256;
+
+// Thrown when the call can't be evaluated, it is then left to run time
+struct NotConstant {};
+
+// The memory of one call, 8 byte slots by their offset from the frame base
+// like the generated code lays them out. Slots never written are missing.
+typedef unordered_map<long, long> Frame;
+
+struct Evaluator {
+    size_t steps = 0;
+    size_t depth = 0;
+    // Set by the return statement that ended the block being run
+    long returned = 0;
+
+    void step() {
+        if (++steps > MAX_STEPS) {
+            throw NotConstant();
+        }
+    }
+
+    long load(Frame& frame, long offset) {
+        auto slot = frame.find(offset);
+        if (slot == frame.end()) {
+            throw NotConstant();
+        }
+        return slot->second;
+    }
+
+    long call(FunctionNode* function, const vector<long>& arguments) {
+        if (!function->isPure || function->block == nullptr ||
+                depth == MAX_DEPTH) {
+            throw NotConstant();
+        }
+        depth++;
+
+        Frame frame;
+        for (size_t i = 0; i < arguments.size(); i++) {
+            frame[function->locals[i]->stackOffset] = arguments[i];
+        }
+
+        bool ended = runBlock(function->block, frame);
+        depth--;
+
+        if (!ended) {
+            if (!function->returnType->isVoid()) {
+                throw NotConstant();
+            }
+            returned = 0;
+        }
+        return returned;
+    }
+
+    long callExpression(FunctionCall* call, Frame& frame) {
+        vector<long> arguments;
+        for (Expression* argument : call->arguments) {
+            arguments.push_back(value(argument, frame));
+        }
+        return this->call(call->function, arguments);
+    }
+
+    // Runs the statements of a block, returns true if one of them returned
+    bool runBlock(Block* block, Frame& frame) {
+        for (Statement* statement : block->statements) {
+            if (run(statement, frame)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool run(Statement* statement, Frame& frame) {
+        step();
+
+        switch (statement->kind) {
+            case NK_ASSIGNMENT: {
+                Assignment* node = (Assignment*)statement;
+                if (node->lhs->type->form == TF_ARRAY) {
+                    throw NotConstant();
+                }
+                long offset = address(node->lhs, frame);
+                frame[offset] = value(node->rhs, frame);
+                return false;
+            }
+            case NK_DECLARATION:
+                return false;
+            case NK_RETURN:
+                returned = value(((Return*)statement)->expr, frame);
+                return true;
+            case NK_FUNCTION_CALL:
+                callExpression(static_cast<FunctionCall*>(statement), frame);
+                return false;
+            case NK_IF:
+                for (If* node = (If*)statement; node != nullptr;
+                        node = node->elseClause) {
+                    if (node->predicate == nullptr ||
+                            value(node->predicate, frame)) {
+                        return runBlock(node->block, frame);
+                    }
+                }
+                return false;
+            case NK_WHILE: {
+                While* node = (While*)statement;
+                while (value(node->expr, frame)) {
+                    if (runBlock(node->block, frame)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            case NK_SWITCH: {
+                Switch* node = (Switch*)statement;
+                long selector = value(node->expr, frame);
+                Block* taken = node->defaultBlock;
+                for (SwitchCase* switchCase : node->cases) {
+                    for (long caseValue : switchCase->values) {
+                        if (caseValue == selector) {
+                            taken = switchCase->block;
+                        }
+                    }
+                }
+                return taken != nullptr && runBlock(taken, frame);
+            }
+            case NK_RANGE_FOR: {
+                // The end is evaluated before every iteration and is
+                // included, as in the generated code
+                RangeFor* node = (RangeFor*)statement;
+                long offset = node->var->stackOffset;
+                frame[offset] = value(node->start, frame);
+                while (load(frame, offset) <= value(node->end, frame)) {
+                    if (runBlock(node->block, frame)) {
+                        return true;
+                    }
+                    step();
+                    unsigned long next = load(frame, offset);
+                    frame[offset] = (long)(next + 1);
+                }
+                return false;
+            }
+            default:
+                throw NotConstant();
+        }
+    }
+
+    // The slot an addressable expression refers to. Array indices are
+    // checked against the variable the array is in.
+    long address(Expression* expr, Frame& frame) {
+        long low, high;
+        return address(expr, frame, low, high);
+    }
+
+    long address(Expression* expr, Frame& frame, long& low, long& high) {
+        step();
+
+        if (expr->kind == NK_VARIABLE) {
+            Variable* var = ((VariableExpression*)expr)->variable;
+            if (var->isGlobal) {
+                throw NotConstant();
+            }
+            low = var->stackOffset;
+            high = low + var->type->size;
+            return low;
+        }
+
+        if (expr->kind != NK_BINARY_OP ||
+                ((BinaryOpExpression*)expr)->op != OP_ARRAY_ACCESS) {
+            throw NotConstant();
+        }
+
+        BinaryOpExpression* node = (BinaryOpExpression*)expr;
+        long base = address(node->lhs, frame, low, high);
+        long index = value(node->rhs, frame);
+        long size = node->type->size;
+        if (index < 0 || index >= (high - base) / size) {
+            throw NotConstant();
+        }
+        return base + index * size;
+    }
+
+    long value(Expression* expr, Frame& frame) {
+        step();
+
+        if (expr->type->form == TF_ARRAY) {
+            throw NotConstant();
+        }
+
+        switch (expr->kind) {
+            case NK_FUNCTION_CALL:
+                return callExpression(static_cast<FunctionCall*>(expr), frame);
+            case NK_BINARY_OP:
+                return binaryOp((BinaryOpExpression*)expr, frame);
+            case NK_UNARY_OP: {
+                UnaryOpExpression* node = (UnaryOpExpression*)expr;
+                if (node->op == OP_LOGICAL_NOT) {
+                    return value(node->expr, frame) ^ 1;
+                }
+                if (node->op == OP_UNARY_MINUS) {
+                    unsigned long operand = value(node->expr, frame);
+                    return (long)-operand;
+                }
+                throw NotConstant();
+            }
+            case NK_VARIABLE:
+                return load(frame, address(expr, frame));
+            case NK_BOOLEAN_LITERAL:
+                return ((BooleanLiteral*)expr)->value;
+            case NK_NUMERIC_LITERAL:
+                return ((NumericLiteral*)expr)->value;
+            default:
+                throw NotConstant();
+        }
+    }
+
+    long binaryOp(BinaryOpExpression* node, Frame& frame) {
+        if (node->op == OP_ARRAY_ACCESS) {
+            return load(frame, address(node, frame));
+        }
+
+        long lhs = value(node->lhs, frame);
+        if (node->op == OP_LOGICAL_AND || node->op == OP_LOGICAL_OR) {
+            if (lhs == (node->op == OP_LOGICAL_OR)) {
+                return lhs;
+            }
+            return value(node->rhs, frame);
+        }
+        long rhs = value(node->rhs, frame);
+
+        switch (node->op) {
+            case OP_ADD:
+                return (long)((unsigned long)lhs + rhs);
+            case OP_SUB:
+                return (long)((unsigned long)lhs - rhs);
+            case OP_MUL:
+                return (long)((unsigned long)lhs * rhs);
+            case OP_DIV:
+            case OP_MOD:
+                if (rhs == 0 || (lhs == LONG_MIN && rhs == -1)) {
+                    throw NotConstant();
+                }
+                return node->op == OP_DIV ? lhs / rhs : lhs % rhs;
+            case OP_EQUAL:
+                return lhs == rhs;
+            case OP_NOT_EQUAL:
+                return lhs != rhs;
+            case OP_GREATER:
+                return lhs > rhs;
+            case OP_GREATER_EQ:
+                return lhs >= rhs;
+            case OP_LESS:
+                return lhs < rhs;
+            case OP_LESS_EQ:
+                return lhs <= rhs;
+            default:
+                assert(false);
+                return 0;
+        }
+    }
+};
+
+bool evaluateCall(FunctionNode* function, const vector<long>& arguments,
+                  long& result)
+{
+    Evaluator evaluator;
+    try {
+        result = evaluator.call(function, arguments);
+    } catch (NotConstant&) {
+        return false;
+    }
+    return true;
+}
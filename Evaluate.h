@@ -0,0 +1,18 @@
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#include <vector>
+
+#include "AST.h"
+
+using namespace std;
+
+// Runs a pure function at compile time with the given argument values and
+// stores what it returns in result. Values are 64 bit and arithmetic wraps
+// around like the generated code. Returns false, leaving the call to run
+// time, if the function would trap, read a variable before writing it, use
+// a pointer, a string or a global, or take too many steps or nested calls.
+extern bool evaluateCall(FunctionNode* function,
+                         const vector<long>& arguments, long& result);
+
+#endif
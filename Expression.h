@@ -1,9 +1,9 @@
 #ifndef EXPRESSION_H
 #define EXPRESSION_H
 
-#include <memory>
 #include <string>
 
+#include "CodeBuffer.h"
 #include "Type.h"
 #include "Symbol.h"
 #include "SymbolTable.h"
@@ -39,77 +39,93 @@ string unaryOpToString(UnaryOperator);
 
 class ErrorCollector;
 
+// Every statement and expression is tagged with its kind. Operations on a
+// Statement or an Expression switch on the kind and call the implementation
+// of the concrete node, there are no virtual functions in the AST.
+enum NodeKind {
+    NK_ASSIGNMENT,
+    NK_DECLARATION,
+    NK_RETURN,
+    NK_FUNCTION_CALL,
+    NK_IF,
+    NK_WHILE,
+    NK_SWITCH,
+    NK_RANGE_FOR,
+    NK_ARRAY_FOR,
+    NK_BINARY_OP,
+    NK_UNARY_OP,
+    NK_VARIABLE,
+    NK_BOOLEAN_LITERAL,
+    NK_NUMERIC_LITERAL,
+    NK_STRING_LITERAL
+};
+
 struct Expression {
     SourceLocation location;
-    shared_ptr<Type> type;
+    NodeKind kind;
+    Type* type = unknownType;
     int temporarySpace = 0;
 
-    virtual ~Expression() {}
-    virtual void cgen(ostream&, bool genAddress=false) = 0;
-    virtual void docgen(ostream& out, bool genAddress=false) {
-        cgen(out, genAddress);
+    Expression(NodeKind kind) {
+        this->kind = kind;
     }
-    virtual bool validate(SymbolTable&, ErrorCollector&) = 0;
-    virtual string toString() const = 0;
-    virtual bool isAddressable() const = 0;
+    void cgen(CodeBuffer&, bool genAddress=false);
+    void docgen(CodeBuffer& out, bool genAddress=false);
+    bool validate(SymbolTable&, ErrorCollector&);
+    string toString() const;
+    bool isAddressable() const;
 };
 
 struct BinaryOpExpression : public Expression {
     BinaryOperator op;
-    unique_ptr<Expression> lhs;
-    unique_ptr<Expression> rhs;
+    Expression* lhs;
+    Expression* rhs;
 
-    BinaryOpExpression(BinaryOperator op, Expression* lhs, Expression* rhs) {
+    BinaryOpExpression(BinaryOperator op, Expression* lhs, Expression* rhs)
+        : Expression(NK_BINARY_OP) {
         this->op = op;
-        this->lhs.reset(lhs);
-        this->rhs.reset(rhs);
+        this->lhs = lhs;
+        this->rhs = rhs;
         this->location = lhs->location;
-        type.reset(new BasicType(T_UNKNOWN));
     }
     string toString() const;
     bool validate(SymbolTable&, ErrorCollector&);
-    void cgen(ostream&, bool);
-    void docgen(ostream&, bool);
+    void cgen(CodeBuffer&, bool);
+    void docgen(CodeBuffer&, bool);
     bool isAddressable() const {return op == OP_ARRAY_ACCESS;}
 };
 
 struct UnaryOpExpression : public Expression {
     UnaryOperator op;
-    unique_ptr<Expression> expr;
+    Expression* expr;
 
-    UnaryOpExpression(UnaryOperator op, Expression* expr) {
+    UnaryOpExpression(UnaryOperator op, Expression* expr)
+        : Expression(NK_UNARY_OP) {
         this->op = op;
-        this->expr.reset(expr);
+        this->expr = expr;
         this->location = expr->location;
-        type.reset(new BasicType(T_UNKNOWN));
-    }
-    UnaryOpExpression(UnaryOperator op, unique_ptr<Expression>& expr) {
-        this->op = op;
-        this->expr = move(expr);
-        this->location = this->expr->location;
-        type.reset(new BasicType(T_UNKNOWN));
     }
     string toString() const;
     bool validate(SymbolTable&, ErrorCollector&);
-    void cgen(ostream&, bool);
+    void cgen(CodeBuffer&, bool);
     bool isAddressable() const {return op == OP_DEREF;}
 };
 
 struct VariableExpression : public Expression {
     Symbol id;
-    shared_ptr<Variable> variable;
+    Variable* variable = nullptr;
 
-    VariableExpression(const Symbol& id) {
+    VariableExpression(const Symbol& id) : Expression(NK_VARIABLE) {
         this->id = id;
-        type.reset(new BasicType(T_UNKNOWN));
     }
     string toString() const;
     bool validate(SymbolTable&, ErrorCollector&);
-    void cgen(ostream&, bool);
+    void cgen(CodeBuffer&, bool);
     bool isAddressable() const {return true;}
 };
 
 struct Literal : public Expression {
+    Literal(NodeKind kind) : Expression(kind) {}
     bool validate(SymbolTable&, ErrorCollector&) {return true;};
     bool isAddressable() const {return false;}
 };
@@ -117,36 +133,37 @@ struct Literal : public Expression {
 struct BooleanLiteral : public Literal {
     bool value;
 
-    BooleanLiteral(bool value) {
+    BooleanLiteral(bool value) : Literal(NK_BOOLEAN_LITERAL) {
         this->value = value;
-        type.reset(new BasicType(T_BOOL));
+        type = boolType;
     }
     string toString() const;
-    void cgen(ostream&, bool);
+    void cgen(CodeBuffer&, bool);
 };
 
 struct NumericLiteral : public Literal {
     long value;
 
-    NumericLiteral(long value) {
+    NumericLiteral(long value) : Literal(NK_NUMERIC_LITERAL) {
         this->value = value;
-        type.reset(new BasicType(T_INT64));
+        type = int64Type;
     }
     string toString() const;
-    void cgen(ostream&, bool);
+    void cgen(CodeBuffer&, bool);
 };
 
 struct StringLiteral : public Literal {
     int poolIndex;
     string value;
 
-    StringLiteral(const string& value, int poolIndex) {
+    StringLiteral(const string& value, int poolIndex)
+        : Literal(NK_STRING_LITERAL) {
         this->value = value;
         this->poolIndex = poolIndex;
-        type.reset(new BasicType(T_STRING));
+        type = stringType;
     }
     string toString() const;
-    void cgen(ostream&, bool);
+    void cgen(CodeBuffer&, bool);
 };
 
 #endif
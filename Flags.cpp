@@ -2,24 +2,21 @@
 #include <limits.h>
 #include <unistd.h>
 #include <iostream>
+#include <thread>
 #include "Flags.h"
 using namespace std;
 
-bool Flags::printAST = false;
 bool Flags::debugParser = false;
-bool Flags::eliminateTailCalls = false;
-string Flags::inputFileName;
-string Flags::libDir;
+int Flags::jobs = 0;
+string Flags::serverSocket;
 
-static string getAbsolutePath(const char* path)
+static string getAbsolutePath(const string& workingDir, const string& path)
 {
-    char dir[PATH_MAX];
-    if (getcwd(dir, sizeof(dir)) == NULL) {
-        perror("Failed to get working directory: ");
-        exit(1);
-    }
+    string result = path;
 
-    string result = string(dir) + '/' + string(path);
+    if (path[0] != '/') {
+        result = workingDir + path;
+    }
 
     if (result[result.length()-1] != '/') {
         result += '/';
@@ -28,34 +25,125 @@ static string getAbsolutePath(const char* path)
     return result;
 }
 
-void parseFlags(int argc, char** argv)
+bool parseCompileFlags(const vector<string>& args, const string& workingDir,
+                       CompileFlags& flags, string& error)
 {
-    bool inputFileFound = false;
+    for (size_t i = 0; i < args.size(); i++) {
+        const string& flag = args[i];
+        bool hasValue = i < args.size()-1;
 
-    for (int i = 1; i < argc; i++) {
-        if (argv[i][0] == '-') {
-            string flag(argv[i]);
+        if (flag[0] == '-') {
             if (flag == "--print-ast") {
-                Flags::printAST = true;
+                flags.printAST = true;
             } else if (flag == "--debug-parser") {
-                Flags::debugParser = true;
+                continue;
             } else if (flag == "--eliminate-tail-recursion") {
-                Flags::eliminateTailCalls = true;
-            } else if (i < argc-1 && flag == "--lib-dir") {
-                Flags::libDir = getAbsolutePath(argv[i+1]);
+                flags.eliminateTailCalls = true;
+            } else if (flag == "--skip-unreachable") {
+                flags.skipUnreachable = true;
+            } else if (flag == "--whole-program") {
+                flags.wholeProgram = true;
+            } else if (hasValue && (flag == "-j" || flag == "--jobs" ||
+                                    flag == "--server")) {
+                i++;
+            } else if (flag == "--cache-stats") {
+                flags.cacheStats = true;
+            } else if (flag == "--time-passes") {
+                flags.timePasses = true;
+            } else if (flag == "--unbuffered") {
+                flags.unbuffered = true;
+            } else if (hasValue && flag == "--data-align") {
+                flags.dataAlignment = atoi(args[i+1].c_str());
+                int alignment = flags.dataAlignment;
+                if (alignment < 8 || (alignment & (alignment - 1)) != 0) {
+                    error = "Invalid data alignment: " + args[i+1] +
+                            ", expected a power of two of at least 8.";
+                    return false;
+                }
+                i++;
+            } else if (hasValue && flag == "--stats") {
+                const string& path = args[i+1];
+                flags.statsFile = path[0] == '/' ? path : workingDir + path;
+                i++;
+            } else if (hasValue && flag == "--cache-dir") {
+                flags.cacheDir = getAbsolutePath(workingDir, args[i+1]);
+                i++;
+            } else if (hasValue && flag == "--lib-dir") {
+                flags.libDir = getAbsolutePath(workingDir, args[i+1]);
+                i++;
+            } else if (hasValue && flag == "-o") {
+                flags.outputDir = getAbsolutePath(workingDir, args[i+1]);
                 i++;
             } else {
-                cerr << "Invalid flag: " << flag << endl;
+                error = "Invalid flag: " + flag;
+                return false;
+            }
+        } else {
+            flags.inputFileNames.push_back(flag);
+        }
+    }
+
+    if (flags.inputFileNames.empty()) {
+        error = "No input file specified.";
+        return false;
+    }
+
+    if (flags.inputFileNames.size() > 1 && flags.outputDir.empty()) {
+        error = "Compiling several input files requires -o <dir>.";
+        return false;
+    }
+
+    return true;
+}
+
+CompileFlags parseFlags(int argc, char** argv)
+{
+    vector<string> args(argv+1, argv+argc);
+
+    for (size_t i = 0; i < args.size(); i++) {
+        const string& flag = args[i];
+        bool hasValue = i < args.size()-1;
+
+        if (flag == "--debug-parser") {
+            Flags::debugParser = true;
+        } else if (hasValue && (flag == "-j" || flag == "--jobs")) {
+            Flags::jobs = atoi(args[i+1].c_str());
+            if (Flags::jobs < 1) {
+                cerr << "Invalid job count: " << args[i+1] << endl;
                 exit(1);
             }
-        } else if (!inputFileFound) {
-            Flags::inputFileName = string(argv[i]);
-            inputFileFound = true;
+            i++;
+        } else if (hasValue && flag == "--server") {
+            Flags::serverSocket = args[i+1];
+            i++;
         }
     }
 
-    if (!inputFileFound) {
-        cerr << "No input file specified." << endl;
+    if (Flags::jobs == 0) {
+        Flags::jobs = thread::hardware_concurrency();
+        if (Flags::jobs == 0) {
+            Flags::jobs = 1;
+        }
+    }
+
+    CompileFlags flags;
+
+    // The server gets the flags of each compilation from its clients
+    if (!Flags::serverSocket.empty()) {
+        return flags;
+    }
+
+    char dir[PATH_MAX];
+    if (getcwd(dir, sizeof(dir)) == NULL) {
+        perror("Failed to get working directory: ");
         exit(1);
     }
+
+    string error;
+    if (!parseCompileFlags(args, string(dir) + '/', flags, error)) {
+        cerr << error << endl;
+        exit(1);
+    }
+
+    return flags;
 }
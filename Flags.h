@@ -2,15 +2,46 @@
 #define FLAGS_H
 
 #include <string>
+#include <vector>
 
+// Process wide flags
 struct Flags {
     static bool debugParser;
-    static bool printAST;
-    static bool eliminateTailCalls;
-    static std::string inputFileName;
-    static std::string libDir;
+    static int jobs;
+    static std::string serverSocket;
 };
 
-extern void parseFlags(int, char**);
+// Flags of a single compilation, from the command line or from a request
+// to the compile server
+struct CompileFlags {
+    bool printAST = false;
+    bool eliminateTailCalls = false;
+    bool skipUnreachable = false;
+    bool wholeProgram = false;
+    bool cacheStats = false;
+    bool timePasses = false;
+    // Alignment of the globals of every module in bytes
+    int dataAlignment = 8;
+    bool unbuffered = false;
+    // If set, the stats of every program are written there as JSON
+    std::string statsFile;
+    std::string cacheDir;
+    std::string libDir;
+    std::vector<std::string> inputFileNames;
+    // With an output directory every input is compiled into an executable
+    // there named after its module, otherwise the single input is compiled
+    // into 'output'
+    std::string outputDir;
+};
+
+// Parses the command line, exits if it is invalid
+extern CompileFlags parseFlags(int, char**);
+
+// Parses the flags of one compilation, relative paths are taken from
+// workingDir. Process wide flags are skipped. Returns false and sets error
+// if the flags are invalid.
+extern bool parseCompileFlags(const std::vector<std::string>& args,
+                              const std::string& workingDir,
+                              CompileFlags& flags, std::string& error);
 
 #endif
@@ -0,0 +1,36 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+// 64 bit FNV-1a, used to key cached objects by their inputs
+struct Hash {
+    uint64_t value = 14695981039346656037ULL;
+
+    void add(const char* data, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            value ^= (unsigned char)data[i];
+            value *= 1099511628211ULL;
+        }
+    }
+
+    void add(uint64_t n) {
+        add((const char*)&n, sizeof(n));
+    }
+
+    // The length is hashed too so that consecutive strings can't run together
+    void add(const std::string& str) {
+        add((uint64_t)str.length());
+        add(str.data(), str.length());
+    }
+
+    std::string hex() const {
+        char buffer[17];
+        snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)value);
+        return std::string(buffer);
+    }
+};
+
+#endif
@@ -0,0 +1,292 @@
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Interface.h"
+
+//
+// Layout, all integers in native byte order:
+//
+//   magic "UI", u16 version
+//   u64 source hash, u64 interface hash, u64 object key
+//   str module name
+//   u32 import count, { u8 is assembly, u8 is library, str path }
+//   u32 called module count, { str name }
+//   u32 function count, { str name, u8 is extern, type return type,
+//                         u32 argument count, { type, str name } }
+//   u32 string count, u64 string bytes
+//
+// str is a u32 length followed by the bytes, type is a u8 TypeForm followed
+// by a u8 BasicTypeId, the pointer base type or u32 elements and the array
+// base type.
+//
+
+static const char MAGIC[2] = {'U', 'I'};
+static const uint16_t VERSION = 2;
+
+struct InterfaceWriter {
+    string data;
+
+    template <typename T>
+    void put(T value) {
+        data.append((const char*)&value, sizeof(value));
+    }
+
+    void putString(const string& str) {
+        put((uint32_t)str.length());
+        data.append(str);
+    }
+
+    void putType(Type* type) {
+        put((uint8_t)type->form);
+        switch (type->form) {
+            case TF_BASIC:
+                put((uint8_t)((BasicType*)type)->typeId);
+                break;
+            case TF_POINTER:
+                putType(((PointerType*)type)->base);
+                break;
+            case TF_ARRAY:
+                put((uint32_t)((ArrayType*)type)->elements);
+                putType(((ArrayType*)type)->base);
+                break;
+        }
+    }
+};
+
+struct InterfaceReader {
+    const char* data;
+    size_t size;
+    size_t position = 0;
+    bool valid = true;
+
+    template <typename T>
+    T get() {
+        T value = T();
+        if (position + sizeof(T) > size) {
+            valid = false;
+            return value;
+        }
+        memcpy(&value, data + position, sizeof(T));
+        position += sizeof(T);
+        return value;
+    }
+
+    string getString() {
+        uint32_t length = get<uint32_t>();
+        if (!valid || position + length > size) {
+            valid = false;
+            return "";
+        }
+        string str(data + position, length);
+        position += length;
+        return str;
+    }
+
+    Type* getType() {
+        Type* type = nullptr;
+
+        switch (get<uint8_t>()) {
+            case TF_BASIC: {
+                uint8_t typeId = get<uint8_t>();
+                if (typeId > T_VOID) {
+                    valid = false;
+                    return nullptr;
+                }
+                type = basicType((BasicTypeId)typeId);
+                break;
+            }
+            case TF_POINTER: {
+                Type* base = getType();
+                if (base == nullptr) {
+                    return nullptr;
+                }
+                type = pointerType(base);
+                break;
+            }
+            case TF_ARRAY: {
+                uint32_t elements = get<uint32_t>();
+                Type* base = getType();
+                if (base == nullptr) {
+                    return nullptr;
+                }
+                type = arrayType(base, elements);
+                break;
+            }
+            default:
+                valid = false;
+        }
+
+        return type;
+    }
+};
+
+string temporaryPath(const string& path)
+{
+    static atomic<unsigned> counter(0);
+    return path + "." + to_string(getpid()) + "." + to_string(counter++) +
+           ".tmp";
+}
+
+bool writeInterface(const string& path, ModuleNode* ast,
+                    const InterfaceInfo& info)
+{
+    InterfaceWriter writer;
+
+    writer.data.append(MAGIC, sizeof(MAGIC));
+    writer.put(VERSION);
+    writer.put(info.sourceHash);
+    writer.put(info.interfaceHash);
+    writer.put(info.objectKey);
+    writer.putString(ast->name);
+
+    writer.put((uint32_t)ast->imports.size());
+    for (Import& import : ast->imports) {
+        writer.put((uint8_t)import.isAssembly);
+        writer.put((uint8_t)import.isLibrary);
+        writer.putString(import.path.str);
+    }
+
+    writer.put((uint32_t)info.calledModules.size());
+    for (const string& name : info.calledModules) {
+        writer.putString(name);
+    }
+
+    writer.put((uint32_t)ast->functions.size());
+    for (FunctionNode* function : ast->functions) {
+        writer.putString(function->id.str());
+        writer.put((uint8_t)(function->block == nullptr));
+        writer.putType(function->returnType);
+        writer.put((uint32_t)function->arguments.size());
+        for (Declaration* argument : function->arguments) {
+            writer.putType(argument->type);
+            writer.putString(argument->ids[0].str());
+        }
+    }
+
+    uint64_t stringBytes = 0;
+    for (string& str : ast->strings) {
+        stringBytes += str.length();
+    }
+    writer.put((uint32_t)ast->strings.size());
+    writer.put(stringBytes);
+
+    string temp = temporaryPath(path);
+    ofstream out(temp.c_str(), ios::trunc | ios::binary);
+    if (!out) {
+        return false;
+    }
+    out << writer.data;
+    out.close();
+
+    return rename(temp.c_str(), path.c_str()) == 0;
+}
+
+ModuleNode* readInterface(const string& path, const string& moduleName,
+                          uint64_t sourceHash, InterfaceInfo& info)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+
+    InterfaceReader reader;
+    reader.data = (const char*)mapping;
+    reader.size = st.st_size;
+
+    unique_ptr<ModuleNode> module(new ModuleNode());
+    module->name = moduleName;
+
+    SourceLocation location;
+    location.line = 0;
+    location.column = 0;
+
+    char magic[2] = {reader.get<char>(), reader.get<char>()};
+    uint16_t version = reader.get<uint16_t>();
+    info.sourceHash = reader.get<uint64_t>();
+    info.interfaceHash = reader.get<uint64_t>();
+    info.objectKey = reader.get<uint64_t>();
+
+    if (!reader.valid || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            version != VERSION || info.sourceHash != sourceHash ||
+            reader.getString() != moduleName) {
+        munmap(mapping, st.st_size);
+        return nullptr;
+    }
+
+    uint32_t importCount = reader.get<uint32_t>();
+    for (uint32_t i = 0; i < importCount && reader.valid; i++) {
+        bool isAssembly = reader.get<uint8_t>() != 0;
+        bool isLibrary = reader.get<uint8_t>() != 0;
+        SourceText importPath{location, reader.getString()};
+        module->imports.push_back(Import{importPath, isAssembly, isLibrary});
+    }
+
+    info.calledModules.clear();
+    uint32_t calledCount = reader.get<uint32_t>();
+    for (uint32_t i = 0; i < calledCount && reader.valid; i++) {
+        info.calledModules.push_back(reader.getString());
+    }
+
+    info.externFunctions.clear();
+    uint32_t functionCount = reader.get<uint32_t>();
+    for (uint32_t i = 0; i < functionCount && reader.valid; i++) {
+        FunctionNode* function = module->arena.make<FunctionNode>();
+        function->location = location;
+        function->id = Symbol{location, moduleName, reader.getString()};
+
+        if (reader.get<uint8_t>() != 0) {
+            info.externFunctions.push_back(function->id.asmString());
+        }
+
+        function->returnType = reader.getType();
+
+        uint32_t argumentCount = reader.get<uint32_t>();
+        for (uint32_t j = 0; j < argumentCount && reader.valid; j++) {
+            Type* type = reader.getType();
+            if (type == nullptr) {
+                break;
+            }
+            vector<Symbol> ids(1, Symbol{location, moduleName,
+                                         reader.getString()});
+            function->arguments.push_back(
+                module->arena.make<Declaration>(type, ids));
+        }
+
+        if (function->returnType == nullptr) {
+            reader.valid = false;
+        }
+        module->functions.push_back(function);
+    }
+
+    // Only the size of the string pool is recorded, the strings themselves
+    // live in the cached object
+    reader.get<uint32_t>();
+    reader.get<uint64_t>();
+
+    munmap(mapping, st.st_size);
+
+    if (!reader.valid) {
+        return nullptr;
+    }
+
+    return module.release();
+}
@@ -0,0 +1,38 @@
+#ifndef INTERFACE_H
+#define INTERFACE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "AST.h"
+
+using namespace std;
+
+// A module interface (.ui) file holds what importers of a module need to
+// type check against it, so that unchanged modules don't have to be parsed
+// and validated again. It is only valid for the exact source it was written
+// from and is only used together with the cached object of the module.
+struct InterfaceInfo {
+    uint64_t sourceHash;
+    uint64_t interfaceHash;
+    uint64_t objectKey;
+    vector<string> calledModules;
+    vector<string> externFunctions;
+};
+
+// Name of a temporary file next to path that is renamed to path once it is
+// complete, unique among all processes and sessions sharing a cache
+extern string temporaryPath(const string& path);
+
+// Writes the interface of a validated module
+extern bool writeInterface(const string& path, ModuleNode* ast,
+                           const InterfaceInfo& info);
+
+// Maps an interface file and builds a module holding only the function
+// signatures and imports. Returns nullptr if the file is missing, corrupt or
+// was written from a different source.
+extern ModuleNode* readInterface(const string& path, const string& moduleName,
+                                 uint64_t sourceHash, InterfaceInfo& info);
+
+#endif
@@ -0,0 +1,1322 @@
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <limits.h>
+#include <assert.h>
+
+#include "Evaluate.h"
+#include "Optimize.h"
+#include "Visitor.h"
+
+using namespace std;
+
+// Functions of at most this many nodes are inlined
+static const size_t MAX_INLINE_NODES = 24;
+// Larger functions are not cloned for their literal arguments
+static const size_t MAX_SPECIALIZE_NODES = 200;
+static const size_t MAX_SPECIALIZATIONS = 4;
+// Each round can expose literals and small functions to the next one
+static const int ROUNDS = 3;
+
+struct Program {
+    FunctionNode* main;
+    unordered_map<string, ModuleNode*> modules;
+    // Reached from main in module order, followed by the clones
+    vector<FunctionNode*> functions;
+    // Can call themselves, directly or through other functions
+    unordered_set<FunctionNode*> recursive;
+    OptimizeStats& stats;
+
+    Program(FunctionNode* main, OptimizeStats& stats)
+        : main(main), stats(stats) {}
+
+    ModuleNode* moduleOf(FunctionNode* function) {
+        return modules[function->id.moduleString()];
+    }
+};
+
+static bool isLiteral(Expression* expr)
+{
+    return expr->kind == NK_NUMERIC_LITERAL ||
+           expr->kind == NK_BOOLEAN_LITERAL;
+}
+
+static long literalValue(Expression* expr)
+{
+    if (expr->kind == NK_NUMERIC_LITERAL) {
+        return ((NumericLiteral*)expr)->value;
+    }
+    return ((BooleanLiteral*)expr)->value;
+}
+
+static Expression* makeLiteral(Arena& arena, NodeKind kind, long value,
+                               const SourceLocation& location)
+{
+    Expression* literal;
+    if (kind == NK_NUMERIC_LITERAL) {
+        literal = arena.make<NumericLiteral>(value);
+    } else {
+        literal = arena.make<BooleanLiteral>(value != 0);
+    }
+    literal->location = location;
+    return literal;
+}
+
+struct NodeCount : Visitor<NodeCount> {
+    size_t count = 0;
+
+    void visit(Statement* statement) {
+        count++;
+        Visitor::visit(statement);
+    }
+
+    void visit(Expression*& expr) {
+        count++;
+        Visitor::visit(expr);
+    }
+};
+
+static size_t countNodes(FunctionNode* function)
+{
+    NodeCount counter;
+    counter.visitFunction(function);
+    return counter.count;
+}
+
+// Only the functions of its module can refer to a global
+struct GlobalUses : Visitor<GlobalUses> {
+    bool found = false;
+
+    void visitVariable(VariableExpression* node) {
+        found = found || node->variable->isGlobal;
+    }
+};
+
+static bool usesGlobals(FunctionNode* function)
+{
+    GlobalUses uses;
+    uses.visitFunction(function);
+    return uses.found;
+}
+
+struct CallCollector : Visitor<CallCollector> {
+    vector<FunctionCall*> calls;
+    bool returns = false;
+
+    void visitFunctionCall(FunctionCall* call) {
+        calls.push_back(call);
+        Visitor::visitFunctionCall(call);
+    }
+
+    void visitReturn(Return* node) {
+        returns = true;
+        Visitor::visitReturn(node);
+    }
+};
+
+// How the variables of a function are used
+struct VariableUses : Visitor<VariableUses> {
+    unordered_map<Variable*, int> reads;
+    unordered_set<Variable*> written;
+    unordered_set<Variable*> addressed;
+
+    void visitAssignment(Assignment* node) {
+        if (node->lhs->kind == NK_VARIABLE) {
+            written.insert(((VariableExpression*)node->lhs)->variable);
+        } else {
+            visit(node->lhs);
+        }
+        visit(node->rhs);
+    }
+
+    void visitRangeFor(RangeFor* node) {
+        written.insert(node->var);
+        Visitor::visitRangeFor(node);
+    }
+
+    void visitUnaryOp(UnaryOpExpression* node) {
+        if (node->op == OP_ADDRESS) {
+            Expression* base = node->expr;
+            while (base->kind == NK_BINARY_OP) {
+                base = ((BinaryOpExpression*)base)->lhs;
+            }
+            if (base->kind == NK_VARIABLE) {
+                addressed.insert(((VariableExpression*)base)->variable);
+            }
+        }
+        Visitor::visitUnaryOp(node);
+    }
+
+    void visitVariable(VariableExpression* node) {
+        reads[node->variable]++;
+    }
+
+    // Only ever read, its reads can be replaced by its value
+    bool isConstant(Variable* var) {
+        return written.count(var) == 0 && addressed.count(var) == 0;
+    }
+};
+
+// Copies statements and expressions from one module into another.
+// Variables in variables are renamed, those in values are replaced by a
+// copy of their value. Strings are added to the pool of the target module.
+struct Copier {
+    ModuleNode* from;
+    ModuleNode* to;
+    unordered_map<Variable*, Variable*> variables;
+    unordered_map<Variable*, Expression*> values;
+
+    Copier(ModuleNode* from, ModuleNode* to) : from(from), to(to) {}
+
+    Variable* rename(Variable* var) {
+        auto renamed = variables.find(var);
+        return renamed != variables.end() ? renamed->second : var;
+    }
+
+    int poolString(StringLiteral* literal) {
+        if (from == to) {
+            return literal->poolIndex;
+        }
+        for (size_t i = 0; i < to->strings.size(); i++) {
+            if (to->strings[i] == literal->value) {
+                return i;
+            }
+        }
+        to->strings.push_back(literal->value);
+        return to->strings.size() - 1;
+    }
+
+    FunctionCall* copyCall(FunctionCall* call) {
+        FunctionCall* result = to->arena.make<FunctionCall>();
+        result->Statement::location = call->Statement::location;
+        result->Expression::location = call->Expression::location;
+        result->id = call->id;
+        result->function = call->function;
+        result->builtin = call->builtin;
+        result->allocated = call->allocated;
+        result->type = call->type;
+        result->temporarySpace = call->temporarySpace;
+        for (Expression* argument : call->arguments) {
+            result->arguments.push_back(copyExpression(argument));
+        }
+        return result;
+    }
+
+    Expression* copyExpression(Expression* expr) {
+        Arena& arena = to->arena;
+        Expression* result;
+
+        switch (expr->kind) {
+            case NK_FUNCTION_CALL:
+                return copyCall(static_cast<FunctionCall*>(expr));
+            case NK_BINARY_OP: {
+                BinaryOpExpression* node = (BinaryOpExpression*)expr;
+                Expression* lhs = copyExpression(node->lhs);
+                Expression* rhs = copyExpression(node->rhs);
+                result = arena.make<BinaryOpExpression>(node->op, lhs, rhs);
+                break;
+            }
+            case NK_UNARY_OP: {
+                UnaryOpExpression* node = (UnaryOpExpression*)expr;
+                result = arena.make<UnaryOpExpression>(
+                    node->op, copyExpression(node->expr));
+                break;
+            }
+            case NK_VARIABLE: {
+                VariableExpression* node = (VariableExpression*)expr;
+                auto value = values.find(node->variable);
+                if (value != values.end()) {
+                    return copyExpression(value->second);
+                }
+                VariableExpression* var =
+                    arena.make<VariableExpression>(node->id);
+                var->variable = rename(node->variable);
+                result = var;
+                break;
+            }
+            case NK_BOOLEAN_LITERAL:
+            case NK_NUMERIC_LITERAL:
+                result = makeLiteral(arena, expr->kind, literalValue(expr),
+                                     expr->location);
+                break;
+            case NK_STRING_LITERAL: {
+                StringLiteral* node = (StringLiteral*)expr;
+                result = arena.make<StringLiteral>(node->value,
+                                                   poolString(node));
+                break;
+            }
+            default:
+                assert(false);
+        }
+
+        result->location = expr->location;
+        result->type = expr->type;
+        result->temporarySpace = expr->temporarySpace;
+        return result;
+    }
+
+    Block* copyBlock(Block* block) {
+        Block* result = to->arena.make<Block>();
+        result->location = block->location;
+        for (Statement* statement : block->statements) {
+            result->statements.push_back(copyStatement(statement));
+        }
+        return result;
+    }
+
+    If* copyIf(If* node) {
+        Expression* predicate = nullptr;
+        If* elseClause = nullptr;
+        if (node->predicate != nullptr) {
+            predicate = copyExpression(node->predicate);
+        }
+        Block* block = copyBlock(node->block);
+        if (node->elseClause != nullptr) {
+            elseClause = copyIf(node->elseClause);
+        }
+        If* result = to->arena.make<If>(predicate, block, elseClause);
+        result->location = node->location;
+        return result;
+    }
+
+    Statement* copyStatement(Statement* statement) {
+        Arena& arena = to->arena;
+        Statement* result;
+
+        switch (statement->kind) {
+            case NK_ASSIGNMENT: {
+                Assignment* node = (Assignment*)statement;
+                Assignment* assignment = arena.make<Assignment>();
+                assignment->lhs = copyExpression(node->lhs);
+                assignment->rhs = copyExpression(node->rhs);
+                result = assignment;
+                break;
+            }
+            case NK_DECLARATION: {
+                Declaration* node = (Declaration*)statement;
+                Declaration* declaration =
+                    arena.make<Declaration>(node->type, node->ids);
+                declaration->inOuterBlock = node->inOuterBlock;
+                result = declaration;
+                break;
+            }
+            case NK_RETURN:
+                result = arena.make<Return>(
+                    copyExpression(((Return*)statement)->expr));
+                break;
+            case NK_FUNCTION_CALL:
+                return copyCall(static_cast<FunctionCall*>(statement));
+            case NK_IF:
+                return copyIf((If*)statement);
+            case NK_WHILE: {
+                While* node = (While*)statement;
+                Expression* expr = copyExpression(node->expr);
+                result = arena.make<While>(expr, copyBlock(node->block));
+                break;
+            }
+            case NK_SWITCH: {
+                Switch* node = (Switch*)statement;
+                Expression* expr = copyExpression(node->expr);
+                vector<SwitchCase*> cases;
+                for (SwitchCase* switchCase : node->cases) {
+                    SwitchCase* copied = arena.make<SwitchCase>(
+                        switchCase->values, copyBlock(switchCase->block));
+                    copied->location = switchCase->location;
+                    cases.push_back(copied);
+                }
+                Block* defaultBlock = nullptr;
+                if (node->defaultBlock != nullptr) {
+                    defaultBlock = copyBlock(node->defaultBlock);
+                }
+                result = arena.make<Switch>(expr, cases, defaultBlock);
+                break;
+            }
+            case NK_RANGE_FOR: {
+                RangeFor* node = (RangeFor*)statement;
+                Expression* start = copyExpression(node->start);
+                Expression* end = copyExpression(node->end);
+                RangeFor* loop = arena.make<RangeFor>(
+                    node->decl, start, end, copyBlock(node->block));
+                loop->var = rename(node->var);
+                result = loop;
+                break;
+            }
+            case NK_ARRAY_FOR: {
+                ArrayFor* node = (ArrayFor*)statement;
+                Expression* arrayExpr = copyExpression(node->arrayExpr);
+                result = arena.make<ArrayFor>(node->decl, arrayExpr,
+                                              copyBlock(node->block));
+                break;
+            }
+            default:
+                assert(false);
+        }
+
+        result->location = statement->location;
+        return result;
+    }
+};
+
+// Temporary space of an expression, computed as validate does
+static int temporaries(Expression* expr)
+{
+    switch (expr->kind) {
+        case NK_FUNCTION_CALL: {
+            FunctionCall* call = static_cast<FunctionCall*>(expr);
+            call->temporarySpace = 0;
+            for (Expression* argument : call->arguments) {
+                call->temporarySpace = max(call->temporarySpace,
+                                           temporaries(argument));
+            }
+            break;
+        }
+        case NK_BINARY_OP: {
+            BinaryOpExpression* node = (BinaryOpExpression*)expr;
+            node->temporarySpace =
+                8 + temporaries(node->lhs) + temporaries(node->rhs);
+            break;
+        }
+        case NK_UNARY_OP: {
+            UnaryOpExpression* node = (UnaryOpExpression*)expr;
+            node->temporarySpace = temporaries(node->expr);
+            break;
+        }
+        default:
+            break;
+    }
+    return expr->temporarySpace;
+}
+
+// Folds operators on literals and drops the branches literal conditions
+// rule out. Arithmetic wraps around like the generated code, divisions that
+// would trap are left to run time.
+struct Folder : Visitor<Folder> {
+    Arena& arena;
+    size_t branches = 0;
+
+    Folder(Arena& arena) : arena(arena) {}
+
+    using Visitor::visit;
+
+    void visit(Expression*& expr) {
+        Visitor::visit(expr);
+        expr = fold(expr);
+    }
+
+    void visitBlock(Block* block) {
+        Visitor::visitBlock(block);
+        foldStatements(block);
+    }
+
+    Expression* literal(Expression* expr, NodeKind kind, long value) {
+        return makeLiteral(arena, kind, value, expr->location);
+    }
+
+    Expression* fold(Expression* expr) {
+        if (expr->kind == NK_UNARY_OP) {
+            UnaryOpExpression* node = (UnaryOpExpression*)expr;
+            if (node->op == OP_UNARY_MINUS &&
+                    node->expr->kind == NK_NUMERIC_LITERAL) {
+                unsigned long value = literalValue(node->expr);
+                return literal(expr, NK_NUMERIC_LITERAL, (long)-value);
+            }
+            if (node->op == OP_LOGICAL_NOT &&
+                    node->expr->kind == NK_BOOLEAN_LITERAL) {
+                return literal(expr, NK_BOOLEAN_LITERAL,
+                               !literalValue(node->expr));
+            }
+            return expr;
+        }
+
+        if (expr->kind != NK_BINARY_OP) {
+            return expr;
+        }
+        BinaryOpExpression* node = (BinaryOpExpression*)expr;
+
+        // The right operand of a short circuit is either the result or
+        // not evaluated at all
+        if ((node->op == OP_LOGICAL_AND || node->op == OP_LOGICAL_OR) &&
+                node->lhs->kind == NK_BOOLEAN_LITERAL) {
+            bool value = literalValue(node->lhs);
+            if (value == (node->op == OP_LOGICAL_OR)) {
+                return node->lhs;
+            }
+            return node->rhs;
+        }
+
+        if (node->lhs->kind != NK_NUMERIC_LITERAL ||
+                node->rhs->kind != NK_NUMERIC_LITERAL) {
+            return expr;
+        }
+
+        long lhs = literalValue(node->lhs);
+        long rhs = literalValue(node->rhs);
+
+        switch (node->op) {
+            case OP_ADD:
+                return literal(expr, NK_NUMERIC_LITERAL,
+                               (long)((unsigned long)lhs + rhs));
+            case OP_SUB:
+                return literal(expr, NK_NUMERIC_LITERAL,
+                               (long)((unsigned long)lhs - rhs));
+            case OP_MUL:
+                return literal(expr, NK_NUMERIC_LITERAL,
+                               (long)((unsigned long)lhs * rhs));
+            case OP_DIV:
+            case OP_MOD:
+                if (rhs == 0 || (lhs == LONG_MIN && rhs == -1)) {
+                    return expr;
+                }
+                return literal(expr, NK_NUMERIC_LITERAL,
+                               node->op == OP_DIV ? lhs / rhs : lhs % rhs);
+            case OP_EQUAL:
+                return literal(expr, NK_BOOLEAN_LITERAL, lhs == rhs);
+            case OP_NOT_EQUAL:
+                return literal(expr, NK_BOOLEAN_LITERAL, lhs != rhs);
+            case OP_GREATER:
+                return literal(expr, NK_BOOLEAN_LITERAL, lhs > rhs);
+            case OP_GREATER_EQ:
+                return literal(expr, NK_BOOLEAN_LITERAL, lhs >= rhs);
+            case OP_LESS:
+                return literal(expr, NK_BOOLEAN_LITERAL, lhs < rhs);
+            case OP_LESS_EQ:
+                return literal(expr, NK_BOOLEAN_LITERAL, lhs <= rhs);
+            default:
+                return expr;
+        }
+    }
+
+    // Drops the clauses of an if chain whose condition is False and ends
+    // the chain at the first one that is True
+    If* foldIf(If* node) {
+        if (node == nullptr) {
+            return nullptr;
+        }
+        if (node->predicate != nullptr &&
+                node->predicate->kind == NK_BOOLEAN_LITERAL) {
+            branches++;
+            if (!literalValue(node->predicate)) {
+                return foldIf(node->elseClause);
+            }
+            node->predicate = nullptr;
+            node->elseClause = nullptr;
+            return node;
+        }
+        node->elseClause = foldIf(node->elseClause);
+        return node;
+    }
+
+    // Only the outer block of a function has declarations, so the
+    // statements of an inner block can be moved into the one around it
+    void foldStatements(Block* block) {
+        vector<Statement*> statements;
+
+        for (Statement* statement : block->statements) {
+            Block* taken = nullptr;
+
+            if (statement->kind == NK_IF) {
+                If* node = foldIf((If*)statement);
+                if (node == nullptr) {
+                    continue;
+                }
+                if (node->predicate == nullptr) {
+                    taken = node->block;
+                } else {
+                    statement = node;
+                }
+            } else if (statement->kind == NK_WHILE) {
+                While* node = (While*)statement;
+                if (node->expr->kind == NK_BOOLEAN_LITERAL &&
+                        !literalValue(node->expr)) {
+                    branches++;
+                    continue;
+                }
+            } else if (statement->kind == NK_SWITCH) {
+                Switch* node = (Switch*)statement;
+                if (node->expr->kind == NK_NUMERIC_LITERAL) {
+                    branches++;
+                    long value = literalValue(node->expr);
+                    taken = node->defaultBlock;
+                    for (SwitchCase* switchCase : node->cases) {
+                        if (find(switchCase->values.begin(),
+                                 switchCase->values.end(), value) !=
+                                switchCase->values.end()) {
+                            taken = switchCase->block;
+                        }
+                    }
+                    if (taken == nullptr) {
+                        continue;
+                    }
+                }
+            }
+
+            if (taken != nullptr) {
+                statements.insert(statements.end(), taken->statements.begin(),
+                                  taken->statements.end());
+            } else {
+                statements.push_back(statement);
+            }
+        }
+
+        // Nothing after a return is reached
+        for (size_t i = 0; i < statements.size(); i++) {
+            if (statements[i]->kind == NK_RETURN) {
+                statements.resize(i + 1);
+            }
+        }
+
+        block->statements = statements;
+    }
+};
+
+// Replaces the reads of variables by their literal values
+struct Substituter : Visitor<Substituter> {
+    Arena& arena;
+    const unordered_map<Variable*, Expression*>& values;
+
+    Substituter(Arena& arena,
+                const unordered_map<Variable*, Expression*>& values)
+        : arena(arena), values(values) {}
+
+    using Visitor::visit;
+
+    void visit(Expression*& expr) {
+        if (expr->kind == NK_VARIABLE) {
+            auto value = values.find(((VariableExpression*)expr)->variable);
+            if (value != values.end()) {
+                expr = makeLiteral(arena, value->second->kind,
+                                   literalValue(value->second),
+                                   expr->location);
+            }
+            return;
+        }
+        Visitor::visit(expr);
+    }
+};
+
+// Finds the cycles of the call graph, Tarjan's strongly connected
+// components
+struct RecursionFinder {
+    Program& program;
+    unordered_map<FunctionNode*, size_t> index;
+    unordered_map<FunctionNode*, size_t> lowLink;
+    unordered_set<FunctionNode*> onStack;
+    vector<FunctionNode*> stack;
+
+    RecursionFinder(Program& program) : program(program) {}
+
+    void visit(FunctionNode* function) {
+        size_t number = index.size();
+        index[function] = number;
+        lowLink[function] = number;
+        stack.push_back(function);
+        onStack.insert(function);
+
+        for (FunctionNode* callee : function->callees) {
+            if (index.count(callee) == 0) {
+                visit(callee);
+                lowLink[function] = min(lowLink[function], lowLink[callee]);
+            } else if (onStack.count(callee) != 0) {
+                lowLink[function] = min(lowLink[function], index[callee]);
+            }
+        }
+
+        if (lowLink[function] != index[function]) {
+            return;
+        }
+
+        vector<FunctionNode*> component;
+        FunctionNode* member;
+        do {
+            member = stack.back();
+            stack.pop_back();
+            onStack.erase(member);
+            component.push_back(member);
+        } while (member != function);
+
+        if (component.size() > 1 || function->callees.count(function) != 0) {
+            program.recursive.insert(component.begin(), component.end());
+        }
+    }
+};
+
+// Rebuilds the call graph after calls were inlined, retargeted or removed.
+// A function that now calls itself other than in a tail call no longer
+// jumps back to its start.
+static void updateCalls(Program& program)
+{
+    for (FunctionNode* function : program.functions) {
+        if (function->block == nullptr) {
+            continue;
+        }
+        CallCollector collector;
+        collector.visitFunction(function);
+
+        function->callees.clear();
+        for (FunctionCall* call : collector.calls) {
+            function->callees.insert(call->function);
+            if (call->function == function &&
+                    function->tailCalls.count(call) == 0) {
+                function->isTailRecursive = false;
+            }
+        }
+    }
+
+    program.recursive.clear();
+    RecursionFinder finder(program);
+    for (FunctionNode* function : program.functions) {
+        if (finder.index.count(function) == 0) {
+            finder.visit(function);
+        }
+    }
+}
+
+static void foldFunctions(Program& program)
+{
+    for (FunctionNode* function : program.functions) {
+        Folder folder(program.moduleOf(function)->arena);
+        folder.visitFunction(function);
+    }
+}
+
+// Arguments every call passes the same literal for are replaced by it in
+// the callee, the calls still pass them
+static void propagateArguments(Program& program)
+{
+    unordered_map<FunctionNode*, vector<FunctionCall*>> calls;
+    for (FunctionNode* function : program.functions) {
+        CallCollector collector;
+        collector.visitFunction(function);
+        for (FunctionCall* call : collector.calls) {
+            calls[call->function].push_back(call);
+        }
+    }
+
+    for (FunctionNode* callee : program.functions) {
+        auto sites = calls.find(callee);
+        if (callee->block == nullptr || callee == program.main ||
+                sites == calls.end()) {
+            continue;
+        }
+
+        VariableUses uses;
+        uses.visitFunction(callee);
+
+        unordered_map<Variable*, Expression*> values;
+        for (size_t i = 0; i < callee->arguments.size(); i++) {
+            Variable* var = callee->locals[i];
+            if (!uses.isConstant(var) || uses.reads[var] == 0) {
+                continue;
+            }
+
+            Expression* value = sites->second[0]->arguments[i];
+            bool same = true;
+            for (FunctionCall* call : sites->second) {
+                Expression* argument = call->arguments[i];
+                same = same && isLiteral(argument) &&
+                       argument->kind == value->kind &&
+                       literalValue(argument) == literalValue(value);
+            }
+            if (same) {
+                values[var] = value;
+            }
+        }
+
+        if (!values.empty()) {
+            Substituter substituter(program.moduleOf(callee)->arena, values);
+            substituter.visitFunction(callee);
+            program.stats.propagatedArguments += values.size();
+        }
+    }
+}
+
+// A copy of function with the literal values of some of its arguments
+// substituted, or nullptr if no branch of the copy folds away
+static FunctionNode* specializeFunction(
+    Program& program, FunctionNode* function, size_t number,
+    const unordered_map<Variable*, Expression*>& values)
+{
+    ModuleNode* module = program.moduleOf(function);
+    Arena& arena = module->arena;
+    Copier copier(module, module);
+    copier.values = values;
+
+    FunctionNode* clone = arena.make<FunctionNode>();
+    clone->location = function->location;
+    clone->arguments = function->arguments;
+    clone->returnType = function->returnType;
+    clone->id = Symbol(function->id.location, function->id.module,
+                       intern(function->id.str() + "$" + to_string(number)));
+    clone->stackSpaceForArgs = function->stackSpaceForArgs;
+    clone->stackSpaceForLocals = function->stackSpaceForLocals;
+    clone->temporarySpace = function->temporarySpace;
+    clone->isTailRecursive = false;
+
+    for (Variable* var : function->locals) {
+        Variable* copy =
+            arena.make<Variable>(var->type, var->symbol, var->stackOffset);
+        copier.variables[var] = copy;
+        clone->locals.push_back(copy);
+    }
+    clone->block = copier.copyBlock(function->block);
+
+    Folder folder(arena);
+    folder.visitFunction(clone);
+    if (folder.branches == 0) {
+        return nullptr;
+    }
+
+    module->functions.push_back(clone);
+    program.functions.push_back(clone);
+    program.stats.specializations++;
+    return clone;
+}
+
+typedef map<pair<FunctionNode*, string>, FunctionNode*> Specializations;
+
+// Calls with literal arguments are retargeted to a clone of the callee
+// specialized for them. Recursive functions are left alone, a clone would
+// turn their tail calls into real ones and could be cloned again for every
+// level of the recursion.
+static void specializeCalls(Program& program, Specializations& clones,
+                            unordered_map<FunctionNode*, size_t>& counts)
+{
+    size_t functionCount = program.functions.size();
+
+    for (size_t f = 0; f < functionCount; f++) {
+        FunctionNode* caller = program.functions[f];
+        CallCollector collector;
+        collector.visitFunction(caller);
+
+        for (FunctionCall* call : collector.calls) {
+            FunctionNode* callee = call->function;
+            if (callee->block == nullptr || callee == program.main ||
+                    program.recursive.count(callee) != 0) {
+                continue;
+            }
+
+            VariableUses uses;
+            uses.visitFunction(callee);
+
+            string key;
+            unordered_map<Variable*, Expression*> values;
+            for (size_t i = 0; i < callee->arguments.size(); i++) {
+                Expression* argument = call->arguments[i];
+                Variable* var = callee->locals[i];
+                if (isLiteral(argument) && uses.isConstant(var) &&
+                        uses.reads[var] != 0) {
+                    key += to_string(i) + "=" +
+                           to_string(literalValue(argument)) + ",";
+                    values[var] = argument;
+                }
+            }
+            if (values.empty()) {
+                continue;
+            }
+
+            auto found = clones.find(make_pair(callee, key));
+            FunctionNode* clone = nullptr;
+            if (found != clones.end()) {
+                clone = found->second;
+            } else {
+                if (counts[callee] < MAX_SPECIALIZATIONS &&
+                        countNodes(callee) <= MAX_SPECIALIZE_NODES) {
+                    clone = specializeFunction(program, callee,
+                                               counts[callee] + 1, values);
+                    if (clone != nullptr) {
+                        counts[callee]++;
+                    }
+                }
+                clones[make_pair(callee, key)] = clone;
+            }
+
+            if (clone != nullptr) {
+                call->function = clone;
+                call->id = clone->id;
+            }
+        }
+    }
+}
+
+// Neither calls, traps nor takes addresses, so evaluating it any number of
+// times, including none, can't be told apart
+static bool isInert(Expression* expr)
+{
+    switch (expr->kind) {
+        case NK_FUNCTION_CALL:
+            return false;
+        case NK_BINARY_OP: {
+            BinaryOpExpression* node = (BinaryOpExpression*)expr;
+            return node->op != OP_DIV && node->op != OP_MOD &&
+                   isInert(node->lhs) && isInert(node->rhs);
+        }
+        case NK_UNARY_OP: {
+            UnaryOpExpression* node = (UnaryOpExpression*)expr;
+            return node->op != OP_DEREF && node->op != OP_ADDRESS &&
+                   isInert(node->expr);
+        }
+        default:
+            return true;
+    }
+}
+
+// No calls and no addresses taken, the arguments can be put in place of
+// the parameters
+static bool isLeaf(Expression* expr)
+{
+    switch (expr->kind) {
+        case NK_FUNCTION_CALL:
+            return false;
+        case NK_BINARY_OP: {
+            BinaryOpExpression* node = (BinaryOpExpression*)expr;
+            return isLeaf(node->lhs) && isLeaf(node->rhs);
+        }
+        case NK_UNARY_OP: {
+            UnaryOpExpression* node = (UnaryOpExpression*)expr;
+            return node->op != OP_ADDRESS && isLeaf(node->expr);
+        }
+        default:
+            return true;
+    }
+}
+
+// Inlines calls to small functions. A function that only returns an
+// expression without calls is inlined into any expression, a void function
+// without return statements replaces a call statement, its parameters and
+// locals becoming locals of the caller.
+struct Inliner : Visitor<Inliner> {
+    Program& program;
+    FunctionNode* caller;
+    ModuleNode* module;
+
+    Inliner(Program& program, FunctionNode* caller)
+        : program(program), caller(caller),
+          module(program.moduleOf(caller)) {}
+
+    using Visitor::visit;
+
+    void visit(Expression*& expr) {
+        Visitor::visit(expr);
+        if (expr->kind == NK_FUNCTION_CALL) {
+            Expression* body = inlineExpression(static_cast<FunctionCall*>(expr));
+            if (body != nullptr) {
+                expr = body;
+                program.stats.inlinedCalls++;
+            }
+        }
+    }
+
+    void visitBlock(Block* block) {
+        Visitor::visitBlock(block);
+
+        vector<Statement*> statements;
+        for (Statement* statement : block->statements) {
+            if (statement->kind != NK_FUNCTION_CALL ||
+                    !inlineStatement(static_cast<FunctionCall*>(statement),
+                                     statements)) {
+                statements.push_back(statement);
+            }
+        }
+        block->statements = statements;
+    }
+
+    bool canInline(FunctionNode* callee) {
+        return callee->block != nullptr && callee != program.main &&
+               program.recursive.count(callee) == 0 &&
+               countNodes(callee) <= MAX_INLINE_NODES &&
+               (program.moduleOf(callee) == module || !usesGlobals(callee));
+    }
+
+    Expression* inlineExpression(FunctionCall* call) {
+        FunctionNode* callee = call->function;
+        if (!canInline(callee) || callee->returnType->isVoid() ||
+                callee->block->statements.size() != 1 ||
+                callee->block->statements[0]->kind != NK_RETURN ||
+                callee->locals.size() != callee->arguments.size()) {
+            return nullptr;
+        }
+
+        Expression* result = ((Return*)callee->block->statements[0])->expr;
+        if (!isLeaf(result)) {
+            return nullptr;
+        }
+
+        VariableUses uses;
+        uses.visitFunction(callee);
+
+        // An argument is evaluated where the parameter is read, unless it
+        // is a literal or a variable that must happen exactly once
+        Copier copier(program.moduleOf(callee), module);
+        for (size_t i = 0; i < callee->arguments.size(); i++) {
+            Expression* argument = call->arguments[i];
+            Variable* var = callee->locals[i];
+            bool simple = isLiteral(argument) ||
+                          argument->kind == NK_VARIABLE ||
+                          argument->kind == NK_STRING_LITERAL;
+            if (!simple && (uses.reads[var] > 1 || !isInert(argument))) {
+                return nullptr;
+            }
+            copier.values[var] = argument;
+        }
+
+        Expression* body = copier.copyExpression(result);
+        caller->temporarySpace += temporaries(body);
+        return body;
+    }
+
+    bool inlineStatement(FunctionCall* call, vector<Statement*>& statements) {
+        FunctionNode* callee = call->function;
+        if (!canInline(callee) || !callee->returnType->isVoid()) {
+            return false;
+        }
+
+        CallCollector collector;
+        collector.visitFunction(callee);
+        if (collector.returns) {
+            return false;
+        }
+
+        VariableUses uses;
+        uses.visitFunction(callee);
+
+        Copier copier(program.moduleOf(callee), module);
+        const SourceLocation& location = call->Statement::location;
+
+        for (size_t i = 0; i < callee->locals.size(); i++) {
+            Variable* var = callee->locals[i];
+            bool isArgument = i < callee->arguments.size();
+
+            if (isArgument && isLiteral(call->arguments[i]) &&
+                    uses.isConstant(var)) {
+                copier.values[var] = call->arguments[i];
+                continue;
+            }
+
+            caller->stackSpaceForLocals += var->type->size;
+            Variable* local = module->arena.make<Variable>(
+                var->type, var->symbol, -caller->stackSpaceForLocals);
+            caller->locals.push_back(local);
+            copier.variables[var] = local;
+
+            if (isArgument) {
+                VariableExpression* lhs =
+                    module->arena.make<VariableExpression>(var->symbol);
+                lhs->variable = local;
+                lhs->type = local->type;
+                lhs->location = location;
+
+                Assignment* assignment = module->arena.make<Assignment>();
+                assignment->location = location;
+                assignment->lhs = lhs;
+                assignment->rhs = call->arguments[i];
+                statements.push_back(assignment);
+
+                caller->temporarySpace = max(caller->temporarySpace,
+                    8 + call->arguments[i]->temporarySpace);
+            }
+        }
+
+        for (Statement* statement : callee->block->statements) {
+            if (statement->kind != NK_DECLARATION) {
+                statements.push_back(copier.copyStatement(statement));
+            }
+        }
+
+        caller->stackSpaceForArgs = max(caller->stackSpaceForArgs,
+                                        callee->stackSpaceForArgs);
+        caller->temporarySpace = max(caller->temporarySpace,
+                                     callee->temporarySpace);
+        caller->callees.insert(callee->callees.begin(),
+                               callee->callees.end());
+        program.stats.inlinedCalls++;
+        return true;
+    }
+};
+
+static void inlineCalls(Program& program)
+{
+    for (FunctionNode* function : program.functions) {
+        if (function->block != nullptr) {
+            Inliner inliner(program, function);
+            inliner.visitFunction(function);
+        }
+    }
+}
+
+// What a function does besides computing its result
+struct Effects : Visitor<Effects> {
+    // Reads or writes memory outside of its frame, globals included
+    bool memory = false;
+    // Loops or divides, so it might not return
+    bool mayNotReturn = false;
+
+    void visitAssignment(Assignment* node) {
+        Expression* base = node->lhs;
+        while (base->kind == NK_BINARY_OP) {
+            base = ((BinaryOpExpression*)base)->lhs;
+        }
+        if (base->kind != NK_VARIABLE) {
+            memory = true;
+        }
+        Visitor::visitAssignment(node);
+    }
+
+    void visitWhile(While* node) {
+        mayNotReturn = true;
+        Visitor::visitWhile(node);
+    }
+
+    void visitRangeFor(RangeFor* node) {
+        mayNotReturn = true;
+        Visitor::visitRangeFor(node);
+    }
+
+    void visitBinaryOp(BinaryOpExpression* node) {
+        if (node->op == OP_DIV || node->op == OP_MOD) {
+            mayNotReturn = true;
+        }
+        Visitor::visitBinaryOp(node);
+    }
+
+    void visitUnaryOp(UnaryOpExpression* node) {
+        if (node->op == OP_DEREF || node->op == OP_ADDRESS) {
+            memory = true;
+        }
+        Visitor::visitUnaryOp(node);
+    }
+
+    void visitVariable(VariableExpression* node) {
+        if (node->variable->isGlobal) {
+            memory = true;
+        }
+    }
+};
+
+// Marks the pure functions and returns those of them that always return,
+// a call to those can be dropped when its result is unused
+static unordered_set<FunctionNode*> findPureFunctions(Program& program)
+{
+    unordered_map<FunctionNode*, Effects> effects;
+
+    // Optimistic, functions calling each other are pure unless one of them
+    // is not
+    for (FunctionNode* function : program.functions) {
+        Effects& found = effects[function];
+        found.visitFunction(function);
+        function->isPure = function->block != nullptr && !found.memory;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (FunctionNode* function : program.functions) {
+            for (FunctionNode* callee : function->callees) {
+                if (function->isPure && !callee->isPure) {
+                    function->isPure = false;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // Pessimistic, recursion might not end
+    unordered_set<FunctionNode*> removable;
+    changed = true;
+    while (changed) {
+        changed = false;
+        for (FunctionNode* function : program.functions) {
+            if (!function->isPure || effects[function].mayNotReturn ||
+                    removable.count(function) != 0) {
+                continue;
+            }
+            bool returns = true;
+            for (FunctionNode* callee : function->callees) {
+                returns = returns && removable.count(callee) != 0;
+            }
+            if (returns) {
+                removable.insert(function);
+                changed = true;
+            }
+        }
+    }
+
+    return removable;
+}
+
+// Has no effect if it is never evaluated
+static bool isRemovable(Expression* expr,
+                        const unordered_set<FunctionNode*>& removable)
+{
+    switch (expr->kind) {
+        case NK_FUNCTION_CALL: {
+            FunctionCall* call = static_cast<FunctionCall*>(expr);
+            if (removable.count(call->function) == 0) {
+                return false;
+            }
+            for (Expression* argument : call->arguments) {
+                if (!isRemovable(argument, removable)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case NK_BINARY_OP: {
+            BinaryOpExpression* node = (BinaryOpExpression*)expr;
+            return node->op != OP_DIV && node->op != OP_MOD &&
+                   isRemovable(node->lhs, removable) &&
+                   isRemovable(node->rhs, removable);
+        }
+        case NK_UNARY_OP: {
+            UnaryOpExpression* node = (UnaryOpExpression*)expr;
+            return node->op != OP_DEREF && isRemovable(node->expr, removable);
+        }
+        default:
+            return true;
+    }
+}
+
+typedef map<pair<FunctionNode*, vector<long>>, pair<bool, long>> Evaluations;
+
+// Replaces calls to pure functions with literal arguments by the value they
+// return, found by running them at compile time. Each distinct call is run
+// once, including those that couldn't be evaluated.
+struct ConstantCalls : Visitor<ConstantCalls> {
+    Arena& arena;
+    Evaluations& evaluations;
+    size_t evaluated = 0;
+
+    ConstantCalls(Arena& arena, Evaluations& evaluations)
+        : arena(arena), evaluations(evaluations) {}
+
+    using Visitor::visit;
+
+    void visit(Expression*& expr) {
+        Visitor::visit(expr);
+        if (expr->kind != NK_FUNCTION_CALL) {
+            return;
+        }
+
+        FunctionCall* call = static_cast<FunctionCall*>(expr);
+        Type* type = call->function->returnType;
+        if (!call->function->isPure || type->form != TF_BASIC ||
+                type->isVoid() || type->isBasicType(T_STRING)) {
+            return;
+        }
+
+        vector<long> arguments;
+        for (Expression* argument : call->arguments) {
+            if (!isLiteral(argument)) {
+                return;
+            }
+            arguments.push_back(literalValue(argument));
+        }
+
+        auto key = make_pair(call->function, arguments);
+        auto found = evaluations.find(key);
+        if (found == evaluations.end()) {
+            long result = 0;
+            bool done = evaluateCall(call->function, arguments, result);
+            found = evaluations.insert(
+                make_pair(key, make_pair(done, result))).first;
+        }
+        if (found->second.first) {
+            NodeKind kind = type->isBasicType(T_BOOL) ? NK_BOOLEAN_LITERAL
+                                                      : NK_NUMERIC_LITERAL;
+            expr = makeLiteral(arena, kind, found->second.second,
+                               expr->location);
+            evaluated++;
+        }
+    }
+};
+
+static void evaluateCalls(Program& program, Evaluations& evaluations)
+{
+    findPureFunctions(program);
+    for (FunctionNode* function : program.functions) {
+        ConstantCalls constants(program.moduleOf(function)->arena,
+                                evaluations);
+        constants.visitFunction(function);
+        program.stats.evaluatedCalls += constants.evaluated;
+    }
+}
+
+// Drops call statements whose result is unused and that have no effect
+struct DeadCalls : Visitor<DeadCalls> {
+    const unordered_set<FunctionNode*>& removable;
+    size_t removed = 0;
+
+    DeadCalls(const unordered_set<FunctionNode*>& removable)
+        : removable(removable) {}
+
+    void visitBlock(Block* block) {
+        Visitor::visitBlock(block);
+
+        vector<Statement*> statements;
+        for (Statement* statement : block->statements) {
+            if (statement->kind == NK_FUNCTION_CALL &&
+                    isRemovable(static_cast<FunctionCall*>(statement),
+                                removable)) {
+                removed++;
+            } else {
+                statements.push_back(statement);
+            }
+        }
+        block->statements = statements;
+    }
+};
+
+void optimizeProgram(const vector<ModuleNode*>& modules, FunctionNode* main,
+                     OptimizeStats& stats)
+{
+    Program program(main, stats);
+
+    unordered_set<FunctionNode*> reached;
+    vector<FunctionNode*> pending(1, main);
+    while (!pending.empty()) {
+        FunctionNode* function = pending.back();
+        pending.pop_back();
+        if (reached.insert(function).second) {
+            pending.insert(pending.end(), function->callees.begin(),
+                           function->callees.end());
+        }
+    }
+
+    // With --skip-unreachable nothing else is validated. Module order keeps
+    // the names of the clones the same from one compilation to the next.
+    for (ModuleNode* module : modules) {
+        program.modules[module->name] = module;
+        for (FunctionNode* function : module->functions) {
+            if (reached.count(function) != 0) {
+                program.functions.push_back(function);
+            }
+        }
+    }
+
+    Specializations clones;
+    unordered_map<FunctionNode*, size_t> counts;
+    Evaluations evaluations;
+
+    updateCalls(program);
+
+    for (int round = 0; round < ROUNDS; round++) {
+        propagateArguments(program);
+        foldFunctions(program);
+        evaluateCalls(program, evaluations);
+        foldFunctions(program);
+        specializeCalls(program, clones, counts);
+        inlineCalls(program);
+        foldFunctions(program);
+        updateCalls(program);
+    }
+
+    unordered_set<FunctionNode*> removable = findPureFunctions(program);
+    for (FunctionNode* function : program.functions) {
+        stats.pureFunctions += function->isPure;
+
+        DeadCalls dead(removable);
+        dead.visitFunction(function);
+        stats.removedCalls += dead.removed;
+    }
+    updateCalls(program);
+}
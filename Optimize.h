@@ -0,0 +1,28 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include <vector>
+
+#include "AST.h"
+#include "Stats.h"
+
+using namespace std;
+
+// Interprocedural passes over the whole program, run once every module is
+// validated and before any code is generated. Only the functions main
+// reaches are looked at:
+//   * arguments every call passes the same literal for are replaced by it
+//     in the callee
+//   * functions are cloned for calls with literal arguments when that lets
+//     branches of the clone fold away, the clones are added to the module
+//     of the function
+//   * small functions are inlined into their callers, across modules
+//   * pure functions are marked, calls to them with literal arguments are
+//     run at compile time and replaced by their result, see Evaluate.h, and
+//     calls that can't loop or trap are removed if their result is unused
+// The modules are changed in place, so they must not be shared with other
+// compilations.
+extern void optimizeProgram(const vector<ModuleNode*>& modules,
+                            FunctionNode* main, OptimizeStats& stats);
+
+#endif
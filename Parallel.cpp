@@ -0,0 +1,85 @@
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Parallel.h"
+#include "Flags.h"
+using namespace std;
+
+// Number of helper threads currently running, shared by all loops
+static atomic<int> busyThreads(0);
+
+static int reserveThreads(int wanted)
+{
+    int busy = busyThreads.load();
+    int reserved;
+
+    do {
+        reserved = Flags::jobs - 1 - busy;
+        if (reserved > wanted) {
+            reserved = wanted;
+        }
+        if (reserved <= 0) {
+            return 0;
+        }
+    } while (!busyThreads.compare_exchange_weak(busy, busy + reserved));
+
+    return reserved;
+}
+
+void parallelFor(size_t count, const function<void(size_t)>& body,
+                 size_t grain)
+{
+    size_t wanted = count / grain;
+    if (wanted > (size_t)Flags::jobs) {
+        wanted = Flags::jobs;
+    }
+
+    int helpers = wanted > 1 ? reserveThreads(wanted - 1) : 0;
+
+    if (helpers == 0) {
+        for (size_t i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    atomic<size_t> next(0);
+    mutex errorLock;
+    exception_ptr error;
+
+    // The first exception stops the loop and is rethrown on the calling
+    // thread once every thread has finished
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < count) {
+            try {
+                body(i);
+            } catch (...) {
+                lock_guard<mutex> guard(errorLock);
+                if (!error) {
+                    error = current_exception();
+                }
+                next = count;
+            }
+        }
+    };
+
+    vector<thread> threads;
+    for (int i = 0; i < helpers; i++) {
+        threads.push_back(thread(worker));
+    }
+
+    worker();
+
+    for (thread& t : threads) {
+        t.join();
+    }
+
+    busyThreads -= helpers;
+
+    if (error) {
+        rethrow_exception(error);
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Calls body(i) for every i in [0, count) using up to Flags::jobs threads,
+// the calling thread included. Returns once every call has finished.
+// Nested calls share the same thread budget, a call that finds no idle
+// threads runs the loop on the calling thread. At most one thread is used
+// per grain iterations. If body throws, the remaining iterations are skipped
+// and the exception is rethrown by parallelFor.
+extern void parallelFor(std::size_t count,
+                        const std::function<void(std::size_t)>& body,
+                        std::size_t grain = 1);
+
+#endif
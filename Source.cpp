@@ -0,0 +1,81 @@
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Source.h"
+using namespace std;
+
+Source::Source(char* buffer, size_t length, size_t mappedLength)
+{
+    this->buffer = buffer;
+    this->length = length;
+    this->mappedLength = mappedLength;
+}
+
+Source::~Source()
+{
+    if (mappedLength != 0) {
+        munmap(buffer, mappedLength);
+    } else {
+        delete[] buffer;
+    }
+}
+
+Source* Source::map(const string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return copy("");
+    }
+
+    // The file is mapped over the start of a slightly larger anonymous
+    // mapping, so the two bytes after it are zero even when the file ends
+    // on a page boundary. Pages are only copied when the lexer writes to
+    // them.
+    size_t length = st.st_size;
+    size_t mappedLength = length + 2;
+
+    void* region = mmap(NULL, mappedLength, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+
+    void* mapping = mmap(region, length, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_FIXED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        munmap(region, mappedLength);
+        return nullptr;
+    }
+
+    return new Source((char*)region, length, mappedLength);
+}
+
+Source* Source::copy(const string& contents)
+{
+    char* buffer = new char[contents.length()+2];
+    memcpy(buffer, contents.data(), contents.length());
+    buffer[contents.length()] = '\0';
+    buffer[contents.length()+1] = '\0';
+    return new Source(buffer, contents.length(), 0);
+}
+
+bool Source::equals(const Source& other) const
+{
+    return length == other.length && memcmp(buffer, other.buffer, length) == 0;
+}
@@ -0,0 +1,43 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <string>
+using namespace std;
+
+// The contents of a source file. Files are mapped instead of read, and the
+// buffer is private to the Source and followed by two NUL bytes so that the
+// lexer can scan it in place. The lexer writes into the buffer while it
+// scans and restores it when it is done.
+class Source {
+private:
+    char* buffer;
+    size_t length;
+    size_t mappedLength; // 0 if the buffer was allocated with new
+
+    Source(char* buffer, size_t length, size_t mappedLength);
+    Source(const Source&);
+    Source& operator=(const Source&);
+public:
+    ~Source();
+
+    // Returns nullptr if the file can't be read
+    static Source* map(const string& path);
+    static Source* copy(const string& contents);
+
+    const char* data() const {
+        return buffer;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    bool equals(const Source& other) const;
+
+    // The buffer the lexer scans, size()+2 bytes long
+    char* scanBuffer() {
+        return buffer;
+    }
+};
+
+#endif
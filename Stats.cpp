@@ -0,0 +1,146 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include "Stats.h"
+
+static double seconds(const timespec& start, const timespec& end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+PhaseTimer::PhaseTimer()
+{
+    clock_gettime(CLOCK_MONOTONIC, &wallStart);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuStart);
+}
+
+void PhaseTimer::stop(PhaseTime& time) const
+{
+    timespec wallEnd;
+    timespec cpuEnd;
+    clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuEnd);
+    time.wall += seconds(wallStart, wallEnd);
+    time.cpu += seconds(cpuStart, cpuEnd);
+}
+
+static string format(const char* spec, ...)
+    __attribute__((format(printf, 1, 2)));
+
+static string format(const char* spec, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, spec);
+    vsnprintf(buffer, sizeof(buffer), spec, args);
+    va_end(args);
+    return buffer;
+}
+
+static string phaseLine(const char* name, const PhaseTime& time)
+{
+    return format("  %-10s %10.3f %10.3f\n", name, time.wall * 1000,
+                  time.cpu * 1000);
+}
+
+string CompileStats::toString() const
+{
+    string result;
+
+    result += format("  %-10s %10s %10s\n", "Phase", "Wall ms", "CPU ms");
+    result += phaseLine("load", load);
+    result += phaseLine("validate", validate);
+    result += phaseLine("optimize", optimize);
+    result += phaseLine("generate", generate);
+    result += phaseLine("link", link);
+
+    result += format("  %-20s %9s %9s %9s %9s %6s %6s %6s %9s\n",
+                     "Module (wall ms)", "parse", "validate", "cgen",
+                     "assemble", "funcs", "stmts", "exprs", "asm bytes");
+    for (const ModuleStats& module : modules) {
+        string name = module.name + (module.isAssembly ? ".s" : "") +
+                      (module.reused ? "*" : "");
+        result += format("  %-20s %9.3f %9.3f %9.3f %9.3f %6zu %6zu %6zu "
+                         "%9zu\n",
+                         name.c_str(), module.parse.wall * 1000,
+                         module.validate.wall * 1000, module.cgen.wall * 1000,
+                         module.assemble.wall * 1000, module.functions,
+                         module.statements, module.expressions,
+                         module.assemblyBytes);
+    }
+
+    result += format("  Symbol table: %zu functions, at most %zu variables\n",
+                     symbolFunctions, symbolPeakVariables);
+    result += format("  Whole program: %zu pure functions, %zu constant "
+                     "arguments, %zu specializations, %zu calls inlined, "
+                     "%zu calls removed, %zu calls evaluated\n",
+                     optimizer.pureFunctions, optimizer.propagatedArguments,
+                     optimizer.specializations, optimizer.inlinedCalls,
+                     optimizer.removedCalls, optimizer.evaluatedCalls);
+    result += format("  Assembly: %zu bytes\n", assemblyBytes);
+    result += format("  Peak RSS: %ld KB\n", peakRSS);
+
+    return result;
+}
+
+string jsonString(const string& str)
+{
+    string result = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if ((unsigned char)c < 0x20) {
+            result += format("\\u%04x", (unsigned char)c);
+        } else {
+            result += c;
+        }
+    }
+    return result + "\"";
+}
+
+static string jsonTime(const PhaseTime& time)
+{
+    return format("{\"wall\": %.6f, \"cpu\": %.6f}", time.wall, time.cpu);
+}
+
+string CompileStats::toJSON() const
+{
+    string result = "{\"phases\": {";
+    result += "\"load\": " + jsonTime(load);
+    result += ", \"validate\": " + jsonTime(validate);
+    result += ", \"optimize\": " + jsonTime(optimize);
+    result += ", \"generate\": " + jsonTime(generate);
+    result += ", \"link\": " + jsonTime(link);
+    result += "}, \"modules\": [";
+
+    for (size_t i = 0; i < modules.size(); i++) {
+        const ModuleStats& module = modules[i];
+        result += i == 0 ? "" : ", ";
+        result += "{\"name\": " + jsonString(module.name);
+        result += format(", \"assembly\": %s, \"reused\": %s",
+                         module.isAssembly ? "true" : "false",
+                         module.reused ? "true" : "false");
+        result += ", \"parse\": " + jsonTime(module.parse);
+        result += ", \"validate\": " + jsonTime(module.validate);
+        result += ", \"cgen\": " + jsonTime(module.cgen);
+        result += ", \"assemble\": " + jsonTime(module.assemble);
+        result += format(", \"functions\": %zu, \"statements\": %zu, "
+                         "\"expressions\": %zu, \"assemblyBytes\": %zu}",
+                         module.functions, module.statements,
+                         module.expressions, module.assemblyBytes);
+    }
+
+    result += format("], \"optimizer\": {\"pureFunctions\": %zu, "
+                     "\"propagatedArguments\": %zu, \"specializations\": %zu, "
+                     "\"inlinedCalls\": %zu, \"removedCalls\": %zu, "
+                     "\"evaluatedCalls\": %zu}",
+                     optimizer.pureFunctions, optimizer.propagatedArguments,
+                     optimizer.specializations, optimizer.inlinedCalls,
+                     optimizer.removedCalls, optimizer.evaluatedCalls);
+    result += format(", \"symbols\": {\"functions\": %zu, "
+                     "\"peakVariables\": %zu}, \"assemblyBytes\": %zu, "
+                     "\"peakRSS\": %ld}",
+                     symbolFunctions, symbolPeakVariables, assemblyBytes,
+                     peakRSS);
+    return result;
+}
@@ -0,0 +1,89 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Wall and CPU time in seconds
+struct PhaseTime {
+    double wall = 0;
+    double cpu = 0;
+
+    PhaseTime& operator+=(const PhaseTime& other) {
+        wall += other.wall;
+        cpu += other.cpu;
+        return *this;
+    }
+};
+
+// Measures the wall time and the CPU time of the calling thread from its
+// construction until stop()
+class PhaseTimer {
+private:
+    timespec wallStart;
+    timespec cpuStart;
+public:
+    PhaseTimer();
+    // Adds the time since the timer was started to time
+    void stop(PhaseTime& time) const;
+};
+
+struct ModuleStats {
+    string name;
+    bool isAssembly = false;
+    // Taken from the module cache or an interface, not parsed or validated
+    bool reused = false;
+
+    // Lexing is driven by the parser, both are in parse
+    PhaseTime parse;
+    PhaseTime validate;
+    PhaseTime cgen;
+    // CPU time of the assembler, wall time of running it
+    PhaseTime assemble;
+
+    size_t functions = 0;
+    size_t statements = 0;
+    size_t expressions = 0;
+    size_t assemblyBytes = 0;
+};
+
+// What the whole program passes did
+struct OptimizeStats {
+    size_t pureFunctions = 0;
+    size_t propagatedArguments = 0;
+    size_t specializations = 0;
+    size_t inlinedCalls = 0;
+    size_t removedCalls = 0;
+    size_t evaluatedCalls = 0;
+};
+
+// Where the time of one compilation went. The wall time of a phase is
+// measured around it, its CPU time is the sum over its modules since they
+// are worked on by several threads. The assembler runs while code is still
+// being generated, so without a cache generate covers both.
+struct CompileStats {
+    PhaseTime load;
+    PhaseTime validate;
+    PhaseTime optimize;
+    PhaseTime generate;
+    PhaseTime link;
+    vector<ModuleStats> modules;
+    OptimizeStats optimizer;
+
+    size_t symbolFunctions = 0;
+    size_t symbolPeakVariables = 0;
+    size_t assemblyBytes = 0;
+    // Of the whole process, in kilobytes
+    long peakRSS = 0;
+
+    string toString() const;
+    string toJSON() const;
+};
+
+// A JSON string literal of str
+extern string jsonString(const string& str);
+
+#endif
@@ -0,0 +1,101 @@
+#include <mutex>
+#include <unordered_map>
+#include "StringPool.h"
+
+using namespace std;
+
+struct PoolEntry {
+    string str;
+    string label;
+};
+
+// Entries live in fixed size chunks that are never moved or freed, so a
+// handle can be resolved without taking the lock
+static const size_t CHUNK_SIZE = 4096;
+static const size_t MAX_CHUNKS = 1 << 16;
+
+struct Pool {
+    mutex lock;
+    unordered_map<string,Name> names;
+    unordered_map<uint64_t,Name> qualifiedNames;
+    PoolEntry* chunks[MAX_CHUNKS] = {};
+    size_t count = 0;
+
+    Pool() {
+        names[""] = add("", "");
+    }
+
+    // Must be called with the lock held
+    Name add(const string& str, const string& label) {
+        if (count % CHUNK_SIZE == 0) {
+            chunks[count / CHUNK_SIZE] = new PoolEntry[CHUNK_SIZE];
+        }
+        PoolEntry& entry = chunks[count / CHUNK_SIZE][count % CHUNK_SIZE];
+        entry.str = str;
+        entry.label = label;
+        return count++;
+    }
+};
+
+// Never destroyed, names may still be used during static destruction
+static Pool& pool()
+{
+    static Pool* instance = new Pool();
+    return *instance;
+}
+
+static const PoolEntry& entry(Name name)
+{
+    return pool().chunks[name / CHUNK_SIZE][name % CHUNK_SIZE];
+}
+
+Name intern(const string& str)
+{
+    Pool& p = pool();
+    lock_guard<mutex> guard(p.lock);
+
+    auto itr = p.names.find(str);
+    if (itr != p.names.end()) {
+        return itr->second;
+    }
+    Name name = p.add(str, "");
+    p.names[str] = name;
+    return name;
+}
+
+Name internQualified(Name module, Name name)
+{
+    Pool& p = pool();
+    uint64_t key = ((uint64_t)module << 32) | name;
+    {
+        lock_guard<mutex> guard(p.lock);
+        auto itr = p.qualifiedNames.find(key);
+        if (itr != p.qualifiedNames.end()) {
+            return itr->second;
+        }
+    }
+
+    const string& moduleStr = nameString(module);
+    const string& nameStr = nameString(name);
+    string str = moduleStr + ":" + nameStr;
+    string label = "$" + moduleStr + "." + nameStr;
+
+    lock_guard<mutex> guard(p.lock);
+    auto itr = p.qualifiedNames.find(key);
+    if (itr != p.qualifiedNames.end()) {
+        return itr->second;
+    }
+    Name qualified = p.add(str, label);
+    p.qualifiedNames[key] = qualified;
+    return qualified;
+}
+
+const string& nameString(Name name)
+{
+    return entry(name).str;
+}
+
+const string& asmLabel(Name qualified)
+{
+    return entry(qualified).label;
+}
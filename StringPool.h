@@ -0,0 +1,23 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <stdint.h>
+#include <string>
+
+// Handle of an interned string. Equal strings always get the same handle,
+// so names can be compared and hashed as integers. Handle 0 is the empty
+// string. The pool is shared by all modules and safe to use from several
+// threads, interned strings are never freed.
+typedef uint32_t Name;
+
+extern Name intern(const std::string&);
+
+// Interns "module:name", the asm label of the result is built only once
+extern Name internQualified(Name module, Name name);
+
+extern const std::string& nameString(Name);
+
+// The "$module.name" label of a name returned by internQualified
+extern const std::string& asmLabel(Name qualified);
+
+#endif
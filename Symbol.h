@@ -3,6 +3,7 @@
 
 #include <string>
 #include "SourceLocation.h"
+#include "StringPool.h"
 
 using namespace std;
 
@@ -13,15 +14,35 @@ struct SourceText {
 
 struct Symbol {
     SourceLocation location;
-    string module;
-    string str;
+    Name module = 0;
+    Name name = 0;
+    Name qualified = 0;
+
+    Symbol() {}
+    Symbol(const SourceLocation& location, Name module, Name name) {
+        this->location = location;
+        this->module = module;
+        this->name = name;
+        this->qualified = internQualified(module, name);
+    }
+    Symbol(const SourceLocation& location, const string& module,
+           const string& str)
+        : Symbol(location, intern(module), intern(str)) {}
+
+    const string& str() const {
+        return nameString(name);
+    }
+
+    const string& moduleString() const {
+        return nameString(module);
+    }
 
-    string qualifiedString() const {
-        return module + ":" + str;
+    const string& qualifiedString() const {
+        return nameString(qualified);
     }
 
-    string asmString() const {
-        return "$" + module + "." + str;
+    const string& asmString() const {
+        return asmLabel(qualified);
     }
 };
 
@@ -3,25 +3,25 @@
 
 SymbolTable::SymbolTable()
 {
-    /*basicTypeIds["int8"]  = T_INT8;
-    basicTypeIds["int16"] = T_INT16;
-    basicTypeIds["int32"] = T_INT32;*/
-    basicTypeIds["int64"] = T_INT64;
-    basicTypeIds["int"] = T_INT64;
+    /*basicTypeIds[intern("int8")]  = T_INT8;
+    basicTypeIds[intern("int16")] = T_INT16;
+    basicTypeIds[intern("int32")] = T_INT32;*/
+    basicTypeIds[intern("int64")] = T_INT64;
+    basicTypeIds[intern("int")] = T_INT64;
     
-    /*basicTypeIds["u8"]  = T_U8;
-    basicTypeIds["u16"] = T_U16;
-    basicTypeIds["u32"] = T_U32;
-    basicTypeIds["u64"] = T_U64;*/
+    /*basicTypeIds[intern("u8")]  = T_U8;
+    basicTypeIds[intern("u16")] = T_U16;
+    basicTypeIds[intern("u32")] = T_U32;
+    basicTypeIds[intern("u64")] = T_U64;*/
 
-    basicTypeIds["bool"] = T_BOOL;
-    basicTypeIds["string"] = T_STRING;
-    basicTypeIds["void"] = T_VOID;
+    basicTypeIds[intern("bool")] = T_BOOL;
+    basicTypeIds[intern("string")] = T_STRING;
+    basicTypeIds[intern("void")] = T_VOID;
 }
 
-shared_ptr<FunctionNode> SymbolTable::getFunction(Symbol symbol) const
+FunctionNode* SymbolTable::getFunction(const Symbol& symbol) const
 {
-    auto itr = functions.find(symbol.qualifiedString());
+    auto itr = functions.find(symbol.qualified);
     if (itr == functions.end()) {
         return nullptr;
     } else {
@@ -29,7 +29,7 @@ shared_ptr<FunctionNode> SymbolTable::getFunction(Symbol symbol) const
     }
 }
 
-shared_ptr<Variable> SymbolTable::getVariable(string name) const
+Variable* SymbolTable::getVariable(Name name) const
 {
     auto itr = variables.find(name);
     if (itr == variables.end()) {
@@ -38,7 +38,16 @@ shared_ptr<Variable> SymbolTable::getVariable(string name) const
     return itr->second;
 }
 
-BasicTypeId SymbolTable::getBasicTypeId(string name) const
+Variable* SymbolTable::getGlobal(const Symbol& symbol) const
+{
+    auto itr = globals.find(symbol.qualified);
+    if (itr == globals.end()) {
+        return nullptr;
+    }
+    return itr->second;
+}
+
+BasicTypeId SymbolTable::getBasicTypeId(Name name) const
 {
     auto itr = basicTypeIds.find(name);
     if (itr == basicTypeIds.end()) {
@@ -47,17 +56,25 @@ BasicTypeId SymbolTable::getBasicTypeId(string name) const
     return itr->second;
 }
 
-void SymbolTable::setFunction(Symbol symbol, shared_ptr<FunctionNode> ftype)
+void SymbolTable::setFunction(const Symbol& symbol, FunctionNode* ftype)
 {
-    functions[symbol.qualifiedString()] = ftype;
+    functions[symbol.qualified] = ftype;
 }
 
-void SymbolTable::setVariable(string name, shared_ptr<Variable> variable)
+void SymbolTable::setVariable(Name name, Variable* variable)
 {
     variables[name] = variable;
+    if (variables.size() > peakVariableCount) {
+        peakVariableCount = variables.size();
+    }
+}
+
+void SymbolTable::setGlobal(const Symbol& symbol, Variable* variable)
+{
+    globals[symbol.qualified] = variable;
 }
 
-void SymbolTable::removeVariable(string name)
+void SymbolTable::removeVariable(Name name)
 {
     variables.erase(name);
 }
@@ -66,3 +83,13 @@ void SymbolTable::clearVariables()
 {
     variables.clear();
 }
+
+size_t SymbolTable::getFunctionCount() const
+{
+    return functions.size();
+}
+
+size_t SymbolTable::getPeakVariableCount() const
+{
+    return peakVariableCount;
+}
@@ -2,7 +2,6 @@
 #define SYMBOL_TABLE_H
 
 #include <unordered_map>
-#include <memory>
 #include <vector>
 #include <string>
 #include "Type.h"
@@ -14,9 +13,12 @@ class FunctionNode;
 struct Variable {
     int stackOffset;
     Symbol symbol;
-    shared_ptr<Type> type;
+    Type* type;
+    // Globals are addressed by their label instead of their stack offset
+    bool isGlobal = false;
+    bool isConstant = false;
 
-    Variable(shared_ptr<Type> type, Symbol& symbol, int stackOffset) {
+    Variable(Type* type, Symbol& symbol, int stackOffset) {
         this->type = type;
         this->symbol = symbol;
         this->stackOffset = stackOffset;
@@ -26,19 +28,29 @@ struct Variable {
 
 class SymbolTable {
 private:
-    unordered_map<string,shared_ptr<FunctionNode>> functions;
-    unordered_map<string,shared_ptr<Variable>> variables;
-    unordered_map<string,BasicTypeId> basicTypeIds;
+    unordered_map<Name,FunctionNode*> functions;
+    unordered_map<Name,Variable*> variables;
+    unordered_map<Name,Variable*> globals;
+    unordered_map<Name,BasicTypeId> basicTypeIds;
+    size_t peakVariableCount = 0;
 public:
     SymbolTable();
 
-    shared_ptr<FunctionNode> getFunction(Symbol symbol) const;
-    shared_ptr<Variable> getVariable(string name) const;
-    BasicTypeId getBasicTypeId(string name) const;
-    void setFunction(Symbol symbol, shared_ptr<FunctionNode> ftype);
-    void setVariable(string name, shared_ptr<Variable> variable);
-    void removeVariable(string name);
+    FunctionNode* getFunction(const Symbol& symbol) const;
+    Variable* getVariable(Name name) const;
+    // Globals are declared by their qualified name, so a module only finds
+    // its own
+    Variable* getGlobal(const Symbol& symbol) const;
+    BasicTypeId getBasicTypeId(Name name) const;
+    void setFunction(const Symbol& symbol, FunctionNode* ftype);
+    void setVariable(Name name, Variable* variable);
+    void setGlobal(const Symbol& symbol, Variable* variable);
+    void removeVariable(Name name);
     void clearVariables();
+
+    size_t getFunctionCount() const;
+    // Most variables in scope at once
+    size_t getPeakVariableCount() const;
 };
 
 #endif
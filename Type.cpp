@@ -1,19 +1,62 @@
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include "Arena.h"
 #include "Type.h"
 
-bool BasicType::isCompatible(Type* type) const
+// Owns every canonical type. Interface files are read on several threads,
+// so derived types are created under a lock.
+struct TypeContext {
+    mutex lock;
+    Arena arena;
+    Type* basicTypes[T_VOID+1];
+    unordered_map<Type*,Type*> pointerTypes;
+    map<pair<Type*,int>,Type*> arrayTypes;
+
+    TypeContext() {
+        for (int id = T_UNKNOWN; id <= T_VOID; id++) {
+            basicTypes[id] = arena.make<BasicType>((BasicTypeId)id);
+        }
+    }
+};
+
+// Never destroyed, like the string pool
+static TypeContext& context()
+{
+    static TypeContext* instance = new TypeContext();
+    return *instance;
+}
+
+Type* basicType(BasicTypeId id)
 {
-    return type->form == TF_BASIC && ((BasicType*)type)->typeId == typeId;
+    return context().basicTypes[id];
 }
 
-bool ArrayType::isCompatible(Type* type) const
+Type* pointerType(Type* base)
 {
-    return type->form == TF_ARRAY
-            && ((ArrayType*)type)->size == size
-            && ((ArrayType*)type)->base->isCompatible(base.get());
+    TypeContext& types = context();
+    lock_guard<mutex> guard(types.lock);
+
+    Type*& type = types.pointerTypes[base];
+    if (type == nullptr) {
+        type = types.arena.make<PointerType>(base);
+    }
+    return type;
 }
 
-bool PointerType::isCompatible(Type* type) const
+Type* arrayType(Type* base, int elements)
 {
-    return type->form == TF_POINTER
-            && ((PointerType*)type)->base->isCompatible(base.get());
+    TypeContext& types = context();
+    lock_guard<mutex> guard(types.lock);
+
+    Type*& type = types.arrayTypes[make_pair(base, elements)];
+    if (type == nullptr) {
+        type = types.arena.make<ArrayType>(base, elements);
+    }
+    return type;
 }
+
+Type* const unknownType = basicType(T_UNKNOWN);
+Type* const boolType = basicType(T_BOOL);
+Type* const int64Type = basicType(T_INT64);
+Type* const stringType = basicType(T_STRING);
@@ -2,7 +2,6 @@
 #define TYPE_H
 
 #include <string>
-#include <memory>
 #include "Symbol.h"
 using namespace std;
 
@@ -32,17 +31,20 @@ enum TypeForm {
 
 string typeToString(BasicTypeId);
 
+// Types written in the source are resolved to canonical types during
+// validation. Every distinct canonical type exists exactly once, so two
+// canonical types are compatible only if they are the same object.
 struct Type {
     SourceLocation location;
     TypeForm form;
     int size;
 
     virtual ~Type() {};
-    virtual bool validate(SymbolTable&, ErrorCollector&) = 0;
+    // Returns the canonical type, or nullptr after reporting an error
+    virtual Type* resolve(SymbolTable&, ErrorCollector&) = 0;
     virtual string toString() const = 0;
     virtual bool isVoid() const {return false;}
     virtual bool isBasicType(BasicTypeId) const {return false;}
-    virtual bool isCompatible(Type*) const {return false;}
 };
 
 struct BasicType : public Type {
@@ -60,43 +62,54 @@ struct BasicType : public Type {
         this->typeId = typeId;
         this->form = TF_BASIC;
         this->size = 8;
-        this->symbol.str = typeToString(typeId);
+        this->location.line = 0;
+        this->location.column = 0;
+        this->symbol.name = intern(typeToString(typeId));
     }
-    bool validate(SymbolTable&, ErrorCollector&);
+    Type* resolve(SymbolTable&, ErrorCollector&);
     string toString() const;
-    bool isCompatible(Type*) const;
     bool isVoid() const {return typeId == T_VOID;}
     bool isBasicType(BasicTypeId id) const {return id == typeId;}
 };
 
 struct ArrayType : public Type {
-    shared_ptr<Type> base;
+    Type* base;
     int elements;
 
-    ArrayType(shared_ptr<Type> base, int elements) {
+    ArrayType(Type* base, int elements) {
         this->elements = elements;
         this->form = TF_ARRAY;
         this->size = base->size * elements;
         this->location = base->location;
         this->base = base;
     }
-    bool validate(SymbolTable&, ErrorCollector&);
+    Type* resolve(SymbolTable&, ErrorCollector&);
     string toString() const;
-    bool isCompatible(Type*) const;
 };
 
 struct PointerType : public Type {
-    shared_ptr<Type> base;
+    Type* base;
 
-    PointerType(shared_ptr<Type> base) {
+    PointerType(Type* base) {
         this->form = TF_POINTER;
         this->size = 8;
         this->location = base->location;
         this->base = base;
     }
-    bool validate(SymbolTable&, ErrorCollector&);
+    Type* resolve(SymbolTable&, ErrorCollector&);
     string toString() const;
-    bool isCompatible(Type*) const;
 };
 
+// Canonical types, safe to call from several threads
+extern Type* basicType(BasicTypeId);
+extern Type* pointerType(Type* base);
+extern Type* arrayType(Type* base, int elements);
+
+// Placeholder type of expressions that have not been validated yet
+extern Type* const unknownType;
+// Shared types of literals and of the results of builtin operators
+extern Type* const boolType;
+extern Type* const int64Type;
+extern Type* const stringType;
+
 #endif
@@ -0,0 +1,165 @@
+#ifndef VISITOR_H
+#define VISITOR_H
+
+#include <assert.h>
+#include "AST.h"
+
+// Base of passes over the AST. A pass derives from Visitor<Pass> and
+// defines the visit functions of the nodes it is interested in, those hide
+// the defaults below which just visit the children. Dispatch is a switch on
+// the node kind, there are no virtual calls. A pass that defines both
+// visit(Statement*) and visit(Expression*&) sees every statement and
+// expression before it is dispatched. Expressions are visited through the
+// pointer that holds them, a pass can replace one by assigning to it.
+template <typename Pass>
+struct Visitor {
+    Pass& pass() {
+        return *static_cast<Pass*>(this);
+    }
+
+    void visitModule(ModuleNode* module) {
+        for (FunctionNode* function : module->functions) {
+            pass().visitFunction(function);
+        }
+    }
+
+    void visitFunction(FunctionNode* function) {
+        if (function->block != nullptr) {
+            pass().visitBlock(function->block);
+        }
+    }
+
+    void visitBlock(Block* block) {
+        for (Statement* statement : block->statements) {
+            pass().visit(statement);
+        }
+    }
+
+    void visit(Statement* statement) {
+        switch (statement->kind) {
+            case NK_ASSIGNMENT:
+                pass().visitAssignment((Assignment*)statement);
+                break;
+            case NK_DECLARATION:
+                pass().visitDeclaration((Declaration*)statement);
+                break;
+            case NK_RETURN:
+                pass().visitReturn((Return*)statement);
+                break;
+            case NK_FUNCTION_CALL:
+                pass().visitFunctionCall(static_cast<FunctionCall*>(statement));
+                break;
+            case NK_IF:
+                pass().visitIf((If*)statement);
+                break;
+            case NK_WHILE:
+                pass().visitWhile((While*)statement);
+                break;
+            case NK_SWITCH:
+                pass().visitSwitch((Switch*)statement);
+                break;
+            case NK_RANGE_FOR:
+                pass().visitRangeFor((RangeFor*)statement);
+                break;
+            case NK_ARRAY_FOR:
+                pass().visitArrayFor((ArrayFor*)statement);
+                break;
+            default:
+                assert(false);
+        }
+    }
+
+    void visit(Expression*& expr) {
+        switch (expr->kind) {
+            case NK_FUNCTION_CALL:
+                pass().visitFunctionCall(static_cast<FunctionCall*>(expr));
+                break;
+            case NK_BINARY_OP:
+                pass().visitBinaryOp((BinaryOpExpression*)expr);
+                break;
+            case NK_UNARY_OP:
+                pass().visitUnaryOp((UnaryOpExpression*)expr);
+                break;
+            case NK_VARIABLE:
+                pass().visitVariable((VariableExpression*)expr);
+                break;
+            case NK_BOOLEAN_LITERAL:
+            case NK_NUMERIC_LITERAL:
+            case NK_STRING_LITERAL:
+                pass().visitLiteral((Literal*)expr);
+                break;
+            default:
+                assert(false);
+        }
+    }
+
+    void visitAssignment(Assignment* node) {
+        pass().visit(node->lhs);
+        pass().visit(node->rhs);
+    }
+
+    void visitDeclaration(Declaration*) {}
+
+    void visitReturn(Return* node) {
+        pass().visit(node->expr);
+    }
+
+    void visitFunctionCall(FunctionCall* node) {
+        for (Expression*& argument : node->arguments) {
+            pass().visit(argument);
+        }
+    }
+
+    void visitIf(If* node) {
+        if (node->predicate != nullptr) {
+            pass().visit(node->predicate);
+        }
+        pass().visitBlock(node->block);
+        if (node->elseClause != nullptr) {
+            pass().visitIf(node->elseClause);
+        }
+    }
+
+    void visitWhile(While* node) {
+        pass().visit(node->expr);
+        pass().visitBlock(node->block);
+    }
+
+    void visitSwitch(Switch* node) {
+        pass().visit(node->expr);
+        for (SwitchCase* switchCase : node->cases) {
+            pass().visitBlock(switchCase->block);
+        }
+        if (node->defaultBlock != nullptr) {
+            pass().visitBlock(node->defaultBlock);
+        }
+    }
+
+    void visitRangeFor(RangeFor* node) {
+        pass().visitDeclaration(node->decl);
+        pass().visit(node->start);
+        pass().visit(node->end);
+        pass().visitBlock(node->block);
+    }
+
+    void visitArrayFor(ArrayFor* node) {
+        pass().visitDeclaration(node->decl);
+        pass().visit(node->arrayExpr);
+        pass().visitBlock(node->block);
+    }
+
+    void visitBinaryOp(BinaryOpExpression* node) {
+        pass().visit(node->lhs);
+        pass().visit(node->rhs);
+    }
+
+    void visitUnaryOp(UnaryOpExpression* node) {
+        pass().visit(node->expr);
+    }
+
+    void visitVariable(VariableExpression*) {}
+
+    void visitLiteral(Literal*) {}
+};
+
+#endif
@@ -1,43 +1,124 @@
-#include <iostream>
+#include <algorithm>
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 
 #include "AST.h"
-#include "Flags.h"
+#include "Compiler.h"
+#include "Parallel.h"
 
 using namespace std;
 
 struct CGenState {
     FunctionNode* function;
     ModuleNode* module;
+    const CompileOptions* options;
     int labelCount = 0;
     int tempIndex = 0;
+    // read only data (jump tables) emitted after the current function
+    CodeBuffer rodata;
 };
 
-CGenState state;
+// Each thread generating code has its own state
+thread_local CGenState state;
 
-void startAsm(ostream& out, const string& moduleName)
+void startAsm(CodeBuffer& out, const string& moduleName, bool unbuffered)
 {
     out << "; vim: set syntax=nasm:\n";
     out << "bits 64\n";
     out << "section .text\n";
-    out << "global _start\n";
+    out << "global _start, _exit, _atexit, _unbuffered\n";
     out << "_start:\n";
     out << "    call " << moduleName << ".main\n";
-    out << "    mov rax, 60\n";
     out << "    mov rdi, 0\n";
-    out << "    syscall\n\n\n";
+    // Exits with the status in rdi, after calling the hook the runtime
+    // sets to flush its output
+    out << "_exit:\n";
+    out << "    mov rax, [_atexit]\n";
+    out << "    cmp rax, 0\n";
+    out << "    je .exit\n";
+    out << "    push rdi\n";
+    out << "    call rax\n";
+    out << "    pop rdi\n";
+    out << ".exit:\n";
+    out << "    mov rax, 60\n";
+    out << "    syscall\n";
+    out << "section .data\n";
+    out << "_atexit:\n";
+    out << "    dq 0\n";
+    out << "_unbuffered:\n";
+    out << "    dq " << (int)unbuffered << "\n\n\n";
 }
 
-void ModuleNode::cgen(ostream& out)
+// Functions below this count per thread are not worth a thread of their own
+static const size_t FUNCTIONS_PER_THREAD = 16;
+
+void ModuleNode::cgen(CodeBuffer& out, const CompileOptions& options,
+                      const vector<bool>& live)
 {
-    state.module = this;
+    // Functions are independent once validated, each one is generated into
+    // its own buffer and the buffers are written in source order
+    vector<CodeBuffer> buffers;
+    cgenFunctions(buffers, options, live);
 
     out << "section .text\n\n";
-    
-    for (shared_ptr<FunctionNode>& func : functions) {
-        func->cgen(out);
+
+    for (CodeBuffer& buffer : buffers) {
+        out << buffer;
+    }
+
+    cgenData(out, options);
+}
+
+void ModuleNode::cgenFunctions(vector<CodeBuffer>& buffers,
+                               const CompileOptions& options,
+                               const vector<bool>& live)
+{
+    buffers.resize(functions.size());
+
+    parallelFor(functions.size(), [&](size_t i) {
+        if (!live.empty() && !live[i]) {
+            return;
+        }
+        state.module = this;
+        state.options = &options;
+        functions[i]->cgen(buffers[i]);
+    }, FUNCTIONS_PER_THREAD);
+}
+
+static string globalLabel(Variable* var)
+{
+    return var->symbol.moduleString() + ".G$" + var->symbol.str();
+}
+
+// Initial values are written 8 to a line, the elements after the last one
+// are zeroed
+static void cgenValues(CodeBuffer& out, ModuleNode* module, Global* global)
+{
+    for (size_t i = 0; i < global->values.size(); i++) {
+        Expression* value = global->values[i];
+        out << (i % 8 == 0 ? "dq " : ", ");
+        if (value->kind == NK_STRING_LITERAL) {
+            out << module->name << ".D$" << ((StringLiteral*)value)->poolIndex;
+        } else if (value->kind == NK_BOOLEAN_LITERAL) {
+            out << ((BooleanLiteral*)value)->value;
+        } else {
+            out << ((NumericLiteral*)value)->value;
+        }
+        if (i % 8 == 7 || i == global->values.size() - 1) {
+            out << "\n";
+        }
+    }
+
+    size_t zeroed = global->type->size / 8 - global->values.size();
+    if (zeroed > 0) {
+        out << "times " << zeroed << " dq 0\n";
     }
+}
+
+void ModuleNode::cgenData(CodeBuffer& out, const CompileOptions& options)
+{
+    int alignment = options.dataAlignment;
 
     out << "section .data\n";
 
@@ -46,9 +127,52 @@ void ModuleNode::cgen(ostream& out)
         out << "dd " << strings[i].size() << "\n";
         out << "db '" << strings[i] << "'\n";
     }
+
+    for (Global* global : globals) {
+        if (global->values.empty() || global->isConstant) {
+            continue;
+        }
+        for (Variable* var : global->variables) {
+            out << "align " << alignment << ", db 0\n";
+            out << globalLabel(var) << ":\n";
+            cgenValues(out, this, global);
+        }
+    }
+
+    bool constants = false;
+    for (Global* global : globals) {
+        if (!global->isConstant) {
+            continue;
+        }
+        if (!constants) {
+            out << "section .rodata\n";
+            constants = true;
+        }
+        for (Variable* var : global->variables) {
+            out << "align " << alignment << ", db 0\n";
+            out << globalLabel(var) << ":\n";
+            cgenValues(out, this, global);
+        }
+    }
+
+    bool zeroed = false;
+    for (Global* global : globals) {
+        if (!global->values.empty()) {
+            continue;
+        }
+        if (!zeroed) {
+            out << "section .bss\n";
+            zeroed = true;
+        }
+        for (Variable* var : global->variables) {
+            out << "alignb " << alignment << "\n";
+            out << globalLabel(var) << ":\n";
+            out << "resb " << var->type->size << "\n";
+        }
+    }
 }
 
-void FunctionNode::cgen(ostream& out)
+void FunctionNode::cgen(CodeBuffer& out)
 {
     if (block == nullptr) {
         return;
@@ -57,6 +181,8 @@ void FunctionNode::cgen(ostream& out)
     state.function = this;
 
     state.labelCount = 0;
+    state.tempIndex = 0;
+    state.rodata.clear();
 
     int stackSpace = stackSpaceForArgs + stackSpaceForLocals + temporarySpace;
     
@@ -65,7 +191,7 @@ void FunctionNode::cgen(ostream& out)
     out << "mov rbp, rsp\n";
     out << "sub rsp, " << stackSpace << "\n";
 
-    if (isTailRecursive && Flags::eliminateTailCalls) {
+    if (isTailRecursive && state.options->eliminateTailCalls) {
         out << id.asmString() << "_tail_call:\n";
     }
 
@@ -75,16 +201,56 @@ void FunctionNode::cgen(ostream& out)
     out << "mov rsp, rbp\n";
     out << "pop rbp\n";
     out << "ret\n\n";
+
+    if (!state.rodata.empty()) {
+        out << "section .rodata\n";
+        out << state.rodata;
+        out << "section .text\n\n";
+    }
+}
+
+void Statement::cgen(CodeBuffer& out)
+{
+    switch (kind) {
+        case NK_ASSIGNMENT:
+            ((Assignment*)this)->cgen(out);
+            break;
+        case NK_DECLARATION:
+            break;
+        case NK_RETURN:
+            ((Return*)this)->cgen(out);
+            break;
+        case NK_FUNCTION_CALL:
+            static_cast<FunctionCall*>(this)->cgen(out);
+            break;
+        case NK_IF:
+            ((If*)this)->cgen(out);
+            break;
+        case NK_WHILE:
+            ((While*)this)->cgen(out);
+            break;
+        case NK_SWITCH:
+            ((Switch*)this)->cgen(out);
+            break;
+        case NK_RANGE_FOR:
+            ((RangeFor*)this)->cgen(out);
+            break;
+        case NK_ARRAY_FOR:
+            ((ArrayFor*)this)->cgen(out);
+            break;
+        default:
+            assert(false);
+    }
 }
 
-void Block::cgen(ostream& out)
+void Block::cgen(CodeBuffer& out)
 {
-    for (unique_ptr<Statement>& statement : statements) {
+    for (Statement* statement : statements) {
         statement->cgen(out);
     }
 }
 
-void Assignment::cgen(ostream& out)
+void Assignment::cgen(CodeBuffer& out)
 {
     int tempLocation =
         state.function->stackSpaceForArgs + state.tempIndex * 8;
@@ -100,26 +266,26 @@ void Assignment::cgen(ostream& out)
     state.tempIndex--;
 }
 
-void Return::cgen(ostream& out)
+void Return::cgen(CodeBuffer& out)
 {
     expr->cgen(out);
     out << "jmp .return\n";
 }
 
-void FunctionCall::cgen(ostream& out, bool genAddress)
+void FunctionCall::cgen(CodeBuffer& out, bool genAddress)
 {
     assert(!genAddress);
     cgen(out);
 }
 
-void FunctionCall::cgen(ostream& out)
+void FunctionCall::cgen(CodeBuffer& out)
 {
-    bool tailCall = Flags::eliminateTailCalls &&
-                    state.function == function.get() &&
+    bool tailCall = state.options->eliminateTailCalls &&
+                    state.function == function &&
                     state.function->isTailRecursive;
     int stackPosition = 0;
 
-    for (unique_ptr<Expression>& argument : arguments) {
+    for (Expression* argument : arguments) {
         argument->cgen(out);
         // TODO: support things bigger than 8 bytes here
         out << "mov [rsp+" << stackPosition << "], rax\n";
@@ -141,7 +307,7 @@ void FunctionCall::cgen(ostream& out)
     }
 }
 
-void If::cgen(ostream& out)
+void If::cgen(CodeBuffer& out)
 {
     int end = state.labelCount++;
 
@@ -156,7 +322,7 @@ void If::cgen(ostream& out)
             out << "jne .L" << next << "\n";
         }
         cur->block->cgen(out);
-        cur = cur->elseClause.get();
+        cur = cur->elseClause;
         if (cur != nullptr) {
             out << "jmp .L" << end << "\n";
         }
@@ -166,7 +332,7 @@ void If::cgen(ostream& out)
     out << ".L" << end << ":\n";
 }
 
-void While::cgen(ostream& out)
+void While::cgen(CodeBuffer& out)
 {
     int label = state.labelCount++;
 
@@ -179,7 +345,182 @@ void While::cgen(ostream& out)
     out << ".LOOP_END_" << label << ":\n";
 }
 
-void RangeFor::cgen(ostream& out)
+// A switch is lowered to one of three dispatch sequences depending on how
+// the case values are distributed:
+//   * a bit test when every value fits in a single 64 bit mask and only a
+//     few distinct blocks are targeted
+//   * a jump table in .rodata when at least a third of the slots between
+//     the smallest and largest value are used
+//   * a binary decision tree otherwise
+// The switch value is in rax for the whole dispatch sequence.
+
+typedef pair<long, int> CaseTarget;
+
+static const size_t MIN_JUMP_TABLE_CASES = 4;
+static const unsigned long MAX_JUMP_TABLE_SIZE = 4096;
+static const size_t MAX_BIT_TEST_TARGETS = 3;
+static const size_t MIN_BIT_TEST_CASES = 3;
+static const size_t MAX_LINEAR_CASES = 3;
+
+static bool fitsImm32(long value)
+{
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static void switchCompare(CodeBuffer& out, long value)
+{
+    if (fitsImm32(value)) {
+        out << "cmp rax, " << value << "\n";
+    } else {
+        out << "mov rcx, " << value << "\n";
+        out << "cmp rax, rcx\n";
+    }
+}
+
+// Rebase the switch value so that the smallest case becomes zero and jump
+// to the default label if it is outside of [0, span]
+static void switchRebase(CodeBuffer& out, long low, unsigned long span,
+                         int defaultLabel)
+{
+    if (low != 0) {
+        if (fitsImm32(low)) {
+            out << "sub rax, " << low << "\n";
+        } else {
+            out << "mov rcx, " << low << "\n";
+            out << "sub rax, rcx\n";
+        }
+    }
+    out << "cmp rax, " << span << "\n";
+    out << "ja .L" << defaultLabel << "\n";
+}
+
+static void switchBitTest(CodeBuffer& out, const vector<CaseTarget>& targets,
+                          int defaultLabel)
+{
+    long low = targets.front().first;
+    unsigned long span = (unsigned long)targets.back().first - low;
+
+    switchRebase(out, low, span, defaultLabel);
+
+    vector<int> labels;
+    for (const CaseTarget& target : targets) {
+        if (find(labels.begin(), labels.end(), target.second) == labels.end()) {
+            labels.push_back(target.second);
+        }
+    }
+
+    for (int label : labels) {
+        unsigned long mask = 0;
+        for (const CaseTarget& target : targets) {
+            if (target.second == label) {
+                mask |= 1UL << ((unsigned long)target.first - low);
+            }
+        }
+        out << "mov rcx, 0x";
+        out.appendHex(mask) << "\n";
+        out << "bt rcx, rax\n";
+        out << "jc .L" << label << "\n";
+    }
+    out << "jmp .L" << defaultLabel << "\n";
+}
+
+static void switchJumpTable(CodeBuffer& out, const vector<CaseTarget>& targets,
+                            int defaultLabel)
+{
+    long low = targets.front().first;
+    unsigned long span = (unsigned long)targets.back().first - low;
+    int table = state.labelCount++;
+
+    switchRebase(out, low, span, defaultLabel);
+    out << "jmp [.SWITCH_TABLE_" << table << " + rax*8]\n";
+
+    state.rodata << "align 8\n";
+    state.rodata << ".SWITCH_TABLE_" << table << ":\n";
+    size_t next = 0;
+    for (unsigned long slot = 0; slot <= span; slot++) {
+        if ((unsigned long)targets[next].first - low == slot) {
+            state.rodata << "dq .L" << targets[next].second << "\n";
+            next++;
+        } else {
+            state.rodata << "dq .L" << defaultLabel << "\n";
+        }
+    }
+}
+
+static void switchDecisionTree(CodeBuffer& out,
+                               const vector<CaseTarget>& targets,
+                               size_t begin, size_t end, int defaultLabel)
+{
+    if (end - begin <= MAX_LINEAR_CASES) {
+        for (size_t i = begin; i < end; i++) {
+            switchCompare(out, targets[i].first);
+            out << "je .L" << targets[i].second << "\n";
+        }
+        out << "jmp .L" << defaultLabel << "\n";
+        return;
+    }
+
+    size_t middle = begin + (end - begin) / 2;
+    int lower = state.labelCount++;
+
+    switchCompare(out, targets[middle].first);
+    out << "je .L" << targets[middle].second << "\n";
+    out << "jl .L" << lower << "\n";
+    switchDecisionTree(out, targets, middle+1, end, defaultLabel);
+    out << ".L" << lower << ":\n";
+    switchDecisionTree(out, targets, begin, middle, defaultLabel);
+}
+
+void Switch::cgen(CodeBuffer& out)
+{
+    int end = state.labelCount++;
+    int defaultLabel = state.labelCount++;
+
+    vector<CaseTarget> targets;
+    vector<int> caseLabels;
+    for (SwitchCase* switchCase : cases) {
+        int label = state.labelCount++;
+        caseLabels.push_back(label);
+        for (long value : switchCase->values) {
+            targets.push_back(CaseTarget(value, label));
+        }
+    }
+    sort(targets.begin(), targets.end());
+
+    expr->cgen(out);
+
+    if (targets.empty()) {
+        out << "jmp .L" << defaultLabel << "\n";
+    } else {
+        unsigned long span =
+            (unsigned long)targets.back().first - targets.front().first;
+
+        if (span < 64 && targets.size() >= MIN_BIT_TEST_CASES &&
+                cases.size() <= MAX_BIT_TEST_TARGETS) {
+            switchBitTest(out, targets, defaultLabel);
+        } else if (targets.size() >= MIN_JUMP_TABLE_CASES &&
+                   span < MAX_JUMP_TABLE_SIZE &&
+                   span < targets.size() * 3) {
+            switchJumpTable(out, targets, defaultLabel);
+        } else {
+            switchDecisionTree(out, targets, 0, targets.size(), defaultLabel);
+        }
+    }
+
+    for (size_t i = 0; i < cases.size(); i++) {
+        out << ".L" << caseLabels[i] << ":\n";
+        cases[i]->block->cgen(out);
+        out << "jmp .L" << end << "\n";
+    }
+
+    out << ".L" << defaultLabel << ":\n";
+    if (defaultBlock != nullptr) {
+        defaultBlock->cgen(out);
+    }
+    out << ".L" << end << ":\n";
+}
+
+void RangeFor::cgen(CodeBuffer& out)
 {
     int label = state.labelCount++;
 
@@ -199,7 +540,7 @@ void RangeFor::cgen(ostream& out)
     out << ".LOOP_END_" << label << ":\n";
 }
 
-void ArrayFor::cgen(ostream& out)
+void ArrayFor::cgen(CodeBuffer& out)
 {
     assert(false);
 }
@@ -208,14 +549,53 @@ void ArrayFor::cgen(ostream& out)
 // Expressions
 //
 
-void BinaryOpExpression::cgen(ostream& out, bool genAddress)
+void Expression::cgen(CodeBuffer& out, bool genAddress)
+{
+    switch (kind) {
+        case NK_FUNCTION_CALL:
+            static_cast<FunctionCall*>(this)->cgen(out, genAddress);
+            break;
+        case NK_BINARY_OP:
+            ((BinaryOpExpression*)this)->cgen(out, genAddress);
+            break;
+        case NK_UNARY_OP:
+            ((UnaryOpExpression*)this)->cgen(out, genAddress);
+            break;
+        case NK_VARIABLE:
+            ((VariableExpression*)this)->cgen(out, genAddress);
+            break;
+        case NK_BOOLEAN_LITERAL:
+            ((BooleanLiteral*)this)->cgen(out, genAddress);
+            break;
+        case NK_NUMERIC_LITERAL:
+            ((NumericLiteral*)this)->cgen(out, genAddress);
+            break;
+        case NK_STRING_LITERAL:
+            ((StringLiteral*)this)->cgen(out, genAddress);
+            break;
+        default:
+            assert(false);
+    }
+}
+
+// Like cgen, but binary operators don't reset the temporaries they use
+void Expression::docgen(CodeBuffer& out, bool genAddress)
+{
+    if (kind == NK_BINARY_OP) {
+        ((BinaryOpExpression*)this)->docgen(out, genAddress);
+    } else {
+        cgen(out, genAddress);
+    }
+}
+
+void BinaryOpExpression::cgen(CodeBuffer& out, bool genAddress)
 {
     int startTempIndex = state.tempIndex;
     docgen(out, genAddress);
     state.tempIndex = startTempIndex;
 }
 
-void BinaryOpExpression::docgen(ostream& out, bool genAddress)
+void BinaryOpExpression::docgen(CodeBuffer& out, bool genAddress)
 {
     if (genAddress) {
         assert(op == OP_ARRAY_ACCESS);
@@ -307,37 +687,28 @@ void BinaryOpExpression::docgen(ostream& out, bool genAddress)
     }
 }
 
-void UnaryOpExpression::cgen(ostream& out, bool genAddress)
+void UnaryOpExpression::cgen(CodeBuffer& out, bool genAddress)
 {
     if (genAddress) {
         assert(op == OP_DEREF);
     }
 
     if (op == OP_ADDRESS) {
-        UnaryOpExpression* uopExpr =
-            dynamic_cast<UnaryOpExpression*>(expr.get());
-        if (uopExpr != nullptr) {
-            assert(uopExpr->op == OP_DEREF);
-            expr->cgen(out);
-            return;
-        }
-
-        BinaryOpExpression* bopExpr =
-            dynamic_cast<BinaryOpExpression*>(expr.get());
-        if (bopExpr != nullptr) {
-            assert(bopExpr->op == OP_ARRAY_ACCESS);
-            expr->cgen(out, true);
-            return;
+        switch (expr->kind) {
+            case NK_UNARY_OP:
+                assert(((UnaryOpExpression*)expr)->op == OP_DEREF);
+                expr->cgen(out);
+                return;
+            case NK_BINARY_OP:
+                assert(((BinaryOpExpression*)expr)->op == OP_ARRAY_ACCESS);
+                expr->cgen(out, true);
+                return;
+            case NK_VARIABLE:
+                expr->cgen(out, true);
+                return;
+            default:
+                assert(false);
         }
-
-        VariableExpression* varExpr =
-            dynamic_cast<VariableExpression*>(expr.get());
-        if (varExpr != nullptr) {
-            out << "lea rax, [rbp+" << varExpr->variable->stackOffset << "]\n";
-            return;
-        }
-
-        assert(false);
     }
 
     expr->cgen(out);
@@ -359,8 +730,17 @@ void UnaryOpExpression::cgen(ostream& out, bool genAddress)
     }
 }
 
-void VariableExpression::cgen(ostream& out, bool genAddress)
+void VariableExpression::cgen(CodeBuffer& out, bool genAddress)
 {
+    if (variable->isGlobal) {
+        if (genAddress) {
+            out << "mov rax, " << globalLabel(variable) << "\n";
+        } else {
+            out << "mov rax, [" << globalLabel(variable) << "]\n";
+        }
+        return;
+    }
+
     if (genAddress) {
         out << "lea";
     } else {
@@ -369,19 +749,19 @@ void VariableExpression::cgen(ostream& out, bool genAddress)
     out << " rax, [rbp+" << variable->stackOffset<< "]\n";
 }
 
-void BooleanLiteral::cgen(ostream& out, bool genAddress)
+void BooleanLiteral::cgen(CodeBuffer& out, bool genAddress)
 {
     assert(!genAddress);
     out << "mov rax, " << value << "\n";
 }
 
-void NumericLiteral::cgen(ostream& out, bool genAddress)
+void NumericLiteral::cgen(CodeBuffer& out, bool genAddress)
 {
     assert(!genAddress);
     out << "mov rax, " << value << "\n";
 }
 
-void StringLiteral::cgen(ostream& out, bool genAddress)
+void StringLiteral::cgen(CodeBuffer& out, bool genAddress)
 {
     assert(!genAddress);
     out << "mov rax, " << state.module->name << ".D$" << poolIndex << "\n";
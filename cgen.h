@@ -1,9 +1,12 @@
 #ifndef CGEN_H
 #define CGEN_H
 
-#include <iostream>
 #include <string>
+#include "CodeBuffer.h"
 
-extern void startAsm(std::ostream&, const std::string&);
+// The entry point of the program, it defines the symbols the runtime in lib
+// exits through
+extern void startAsm(CodeBuffer&, const std::string& moduleName,
+                     bool unbuffered);
 
 #endif
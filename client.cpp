@@ -0,0 +1,98 @@
+#include <iostream>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+//
+// Thin client of the compile server (compiler --server <socket>). It sends
+// its working directory and arguments to the server and prints what the
+// server sends back, the protocol is described in main.cpp.
+//
+// Usage: compiler-client <socket> [options] <file.u>
+//
+
+bool writeAll(int fd, const string& data)
+{
+    for (size_t sent = 0; sent < data.length(); ) {
+        ssize_t count = write(fd, data.data() + sent, data.length() - sent);
+        if (count <= 0) {
+            return false;
+        }
+        sent += count;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <socket> [options] <file.u>" << endl;
+        return 1;
+    }
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (strlen(argv[1]) >= sizeof(address.sun_path)) {
+        cerr << "Socket path too long: " << argv[1] << endl;
+        return 1;
+    }
+    strcpy(address.sun_path, argv[1]);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 ||
+            connect(server, (sockaddr*)&address, sizeof(address)) != 0) {
+        perror("Failed to connect to server: ");
+        return 1;
+    }
+
+    char dir[PATH_MAX];
+    if (getcwd(dir, sizeof(dir)) == NULL) {
+        perror("Failed to get working directory: ");
+        return 1;
+    }
+
+    string request = string(dir) + '/' + '\0';
+    for (int i = 2; i < argc; i++) {
+        request += string(argv[i]) + '\0';
+    }
+
+    if (!writeAll(server, request)) {
+        perror("Failed to send request: ");
+        return 1;
+    }
+    shutdown(server, SHUT_WR);
+
+    string response;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(server, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, count);
+    }
+    close(server);
+
+    int status;
+    size_t outLength;
+    size_t errLength;
+    int headerLength;
+    if (sscanf(response.c_str(), "%d\n%zu\n%zu\n%n", &status, &outLength,
+               &errLength, &headerLength) != 3 ||
+            headerLength + outLength + errLength != response.length()) {
+        cerr << "Invalid response from server." << endl;
+        return 1;
+    }
+
+    cout << response.substr(headerLength, outLength);
+    cerr << response.substr(headerLength + outLength, errLength);
+
+    return status;
+}
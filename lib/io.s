@@ -1,4 +1,14 @@
 ; vim: set syntax=nasm:
+
+; Output goes to a 64 KB buffer, written to stdout when it is full, by
+; io.flush and when the program exits through _atexit. Programs compiled
+; with --unbuffered write it right away.
+;
+; Numbers are formatted backwards from their last digit two digits at a
+; time, dividing by 100 with a multiplication by its reciprocal and taking
+; the digits from a table. Input is read into a buffer of its own and
+; parsed 8 digits at a time where it can be.
+
 section .text
 
 io.print64:
@@ -6,62 +16,431 @@ io.print64:
     sub rsp, 32
     lea rsi, [rsp+31]
     mov [rsi], BYTE 0xA
-    mov rcx, 1
+    cmp rax, 0
+    jge .digits
 
-.loop:
-    mov rdx, 0
-    mov rbx, 10
-    div rbx
-    add dl, '0'
+    ; the most negative number is its own negation, which is right for
+    ; the unsigned digits
+    neg rax
+    call io.decimal
     dec rsi
-    mov [rsi], dl
-    inc rcx
-    cmp rax, 0
-    jne .loop
+    mov [rsi], BYTE '-'
+    jmp .write
 
-    mov rax, 1
-    mov rdi, 1
-    mov rdx, rcx
-    syscall
+.digits:
+    call io.decimal
+.write:
+    lea rdx, [rsp+32]
+    sub rdx, rsi
+    call io.writeShort
 
     add rsp, 32
     ret
 
 
-io.println:
-    push rbp
-    mov rbp, rsp
+io.printUnsigned:
+    mov rax, [rsp+8]
+    sub rsp, 32
+    lea rsi, [rsp+31]
+    mov [rsi], BYTE 0xA
+    call io.decimal
 
-    mov rax, [rbp+16]
-    mov ecx, [rax]
-    lea rsi, [rax+4]
+    lea rdx, [rsp+32]
+    sub rdx, rsi
+    call io.writeShort
 
-    sub rsp, rcx
-    sub rsp, 1
+    add rsp, 32
+    ret
 
-    mov rdi, rsp
+
+io.printHex:
+    mov rax, [rsp+8]
+    sub rsp, 32
+    lea rsi, [rsp+31]
+    mov [rsi], BYTE 0xA
 
 .loop:
-    cmp rcx, 0
-    je .end
-    mov al, [rsi]
-    mov [rdi], al
+    movzx ecx, al
+    movzx ecx, WORD [io.hexPairs+rcx*2]
+    sub rsi, 2
+    mov [rsi], cx
+    shr rax, 8
+    jnz .loop
+    ; no leading zero, but 0 has a digit left
+    cmp BYTE [rsi], '0'
+    jne .write
+    inc rsi
+
+.write:
+    lea rdx, [rsp+32]
+    sub rdx, rsi
+    call io.writeShort
+
+    add rsp, 32
+    ret
+
+
+io.println:
+    mov rax, [rsp+8]
+    mov edx, [rax]
+    lea rsi, [rax+4]
+    call io.write
+
+    mov rsi, io.newline
+    mov rdx, 1
+    jmp io.write
+
+
+io.flush:
+    mov rsi, io.buffer
+    mov rdx, [io.used]
+    mov QWORD [io.used], 0
+    jmp io.writeAll
+
+
+io.parseInt:
+    mov rax, [rsp+8]
+    mov edi, [rax]
+    lea rsi, [rax+4]
+    add rdi, rsi
+    jmp io.parse
+
+
+; Skips everything up to the next number on stdin and parses it. Returns 0
+; and sets io.ended if there is none. Input is only waited for while the
+; number could go on, so a line can be answered before the next one.
+io.readInt:
+    mov rsi, [io.inPos]
+    mov rdi, [io.inEnd]
+.scan:
+    cmp rsi, rdi
+    jae .more
+    movzx eax, BYTE [rsi]
+    sub eax, '0'
+    cmp eax, 9
+    jbe .found
+    cmp eax, '-'-'0'
+    je .sign
+    cmp eax, '+'-'0'
+    je .sign
+.skip:
     inc rsi
-    inc rdi
-    dec rcx
-    jmp .loop
+    jmp .scan
+
+    ; a sign starts a number only if a digit follows
+.sign:
+    lea rax, [rsi+1]
+    cmp rax, rdi
+    jae .more
+    movzx eax, BYTE [rsi+1]
+    sub eax, '0'
+    cmp eax, 9
+    ja .skip
+
+.found:
+    mov [io.inPos], rsi
+    lea rdx, [rsi+1]
+.digits:
+    cmp rdx, rdi
+    jae .last
+    movzx eax, BYTE [rdx]
+    sub eax, '0'
+    cmp eax, 9
+    ja .parse
+    inc rdx
+    jmp .digits
+
+    ; the digits run up to the end of what was read, unless they fill it
+.last:
+    cmp QWORD [io.inputDone], 0
+    jne .parse
+    mov rax, rdi
+    sub rax, rsi
+    cmp rax, 65536
+    jae .parse
+    call io.fill
+    jmp io.readInt
+
+.parse:
+    call io.parse
+    mov [io.inPos], rsi
+    ret
+
+.more:
+    mov [io.inPos], rsi
+    cmp QWORD [io.inputDone], 0
+    jne .end
+    call io.fill
+    jmp io.readInt
 .end:
+    mov QWORD [io.ended], 1
+    mov rax, 0
+    ret
+
+
+io.atEnd:
+    mov rax, [io.ended]
+    ret
+
+
+; Parses a decimal number with an optional sign from the bytes at rsi up
+; to rdi, stopping at the first byte that isn't a digit. Returns it in rax
+; and the byte after it in rsi. Numbers that don't fit wrap around.
+io.parse:
+    mov rax, 0
+    mov r8, 0
+    cmp rsi, rdi
+    jae .done
+    cmp BYTE [rsi], '-'
+    jne .plus
+    mov r8, 1
+    inc rsi
+    jmp .eight
+.plus:
+    cmp BYTE [rsi], '+'
+    jne .eight
+    inc rsi
+
+    ; 8 digits at once: the bytes are checked to be digits together, then
+    ; pairs, quads and the two halves are combined with multiplications
+.eight:
+    lea rcx, [rsi+8]
+    cmp rcx, rdi
+    ja .digit
+    mov rcx, [rsi]
+    mov rdx, rcx
+    mov r9, 0x0606060606060606
+    add rdx, r9
+    mov r9, 0xF0F0F0F0F0F0F0F0
+    and rdx, r9
+    shr rdx, 4
+    mov r10, rcx
+    and r10, r9
+    or rdx, r10
+    mov r9, 0x3333333333333333
+    cmp rdx, r9
+    jne .digit
+
+    mov r9, 0x0F0F0F0F0F0F0F0F
+    and rcx, r9
+    imul rcx, rcx, 2561
+    shr rcx, 8
+    mov r9, 0x00FF00FF00FF00FF
+    and rcx, r9
+    imul rcx, rcx, 6553601
+    shr rcx, 16
+    mov r9, 0x0000FFFF0000FFFF
+    and rcx, r9
+    mov r9, 42949672960001
+    imul rcx, r9
+    shr rcx, 32
+    imul rax, rax, 100000000
+    add rax, rcx
+    add rsi, 8
+    jmp .eight
+
+.digit:
+    cmp rsi, rdi
+    jae .sign
+    movzx edx, BYTE [rsi]
+    sub edx, '0'
+    cmp edx, 9
+    ja .sign
+    lea rax, [rax+rax*4]
+    lea rax, [rdx+rax*2]
+    inc rsi
+    jmp .digit
+
+.sign:
+    cmp r8, 0
+    je .done
+    neg rax
+.done:
+    ret
+
+
+; Writes the digits of the unsigned rax right before rsi, leaves rsi at
+; the first one
+io.decimal:
+    cmp rax, 100
+    jb .last
+    ; rax / 100 is the high half of (rax / 4) * ceil(2^66 / 100), over 4
+    mov rcx, rax
+    shr rax, 2
+    mov rdx, 0x28F5C28F5C28F5C3
+    mul rdx
+    shr rdx, 2
+    imul rax, rdx, 100
+    sub rcx, rax
+    movzx ecx, WORD [io.pairs+rcx*2]
+    sub rsi, 2
+    mov [rsi], cx
+    mov rax, rdx
+    jmp io.decimal
+
+.last:
+    cmp rax, 10
+    jb .one
+    movzx ecx, WORD [io.pairs+rax*2]
+    sub rsi, 2
+    mov [rsi], cx
+    ret
+.one:
+    add al, '0'
+    dec rsi
+    mov [rsi], al
+    ret
+
 
-    mov [rdi], BYTE 10
+; Appends rdx bytes at rsi to the buffer. When they don't fit the buffer is
+; written first, and they are written directly if they don't fit at all.
+io.write:
+    mov QWORD [_atexit], io.flush
+    mov rax, [io.used]
+    lea rcx, [rax+rdx]
+    cmp rcx, 65536
+    jbe .copy
 
+    push rsi
+    push rdx
+    call io.flush
+    pop rdx
+    pop rsi
+    cmp rdx, 65536
+    ja io.writeAll
+    mov rax, 0
+    mov rcx, rdx
+
+.copy:
+    mov [io.used], rcx
+    lea rdi, [io.buffer+rax]
+    mov rcx, rdx
+    rep movsb
+
+    cmp QWORD [_unbuffered], 0
+    jne io.flush
+    ret
+
+
+; io.write for at most 32 bytes, which are copied as two 16 byte blocks
+; whatever their length. What is copied past them is overwritten later.
+io.writeShort:
+    mov QWORD [_atexit], io.flush
+    mov rax, [io.used]
+    cmp rax, 65536-32
+    jbe .copy
+
+    push rsi
+    push rdx
+    call io.flush
+    pop rdx
+    pop rsi
+    mov rax, 0
+
+.copy:
+    movdqu xmm0, [rsi]
+    movdqu xmm1, [rsi+16]
+    movdqu [io.buffer+rax], xmm0
+    movdqu [io.buffer+rax+16], xmm1
+    add rax, rdx
+    mov [io.used], rax
+
+    cmp QWORD [_unbuffered], 0
+    jne io.flush
+    ret
+
+
+; Writes rdx bytes at rsi to stdout, write can take fewer at a time
+io.writeAll:
+    cmp rdx, 0
+    jle .done
     mov rax, 1
     mov rdi, 1
-    mov rsi, rsp
-    mov rdx, [rbp+16]
-    mov edx, [rdx]
-    inc edx
     syscall
+    cmp rax, 0
+    jle .done
+    add rsi, rax
+    sub rdx, rax
+    jmp io.writeAll
+.done:
+    ret
+
 
-    mov rsp, rbp
-    pop rbp
+; Moves the unread input to the start of its buffer and reads more after
+; it, sets io.inputDone when there is no more
+io.fill:
+    mov rsi, [io.inPos]
+    mov rcx, [io.inEnd]
+    sub rcx, rsi
+    mov rdi, io.input
+    mov [io.inPos], rdi
+    rep movsb
+
+    mov rsi, rdi
+    mov rdx, io.input+65536
+    sub rdx, rdi
+    mov rax, 0
+    mov rdi, 0
+    syscall
+    cmp rax, 0
+    jg .read
+    mov QWORD [io.inputDone], 1
+    mov rax, 0
+.read:
+    add rsi, rax
+    mov [io.inEnd], rsi
     ret
+
+
+section .data
+io.newline:
+    db 10
+
+; "00" to "99"
+io.pairs:
+    db '00010203040506070809'
+    db '10111213141516171819'
+    db '20212223242526272829'
+    db '30313233343536373839'
+    db '40414243444546474849'
+    db '50515253545556575859'
+    db '60616263646566676869'
+    db '70717273747576777879'
+    db '80818283848586878889'
+    db '90919293949596979899'
+
+; "00" to "ff"
+io.hexPairs:
+    db '000102030405060708090a0b0c0d0e0f'
+    db '101112131415161718191a1b1c1d1e1f'
+    db '202122232425262728292a2b2c2d2e2f'
+    db '303132333435363738393a3b3c3d3e3f'
+    db '404142434445464748494a4b4c4d4e4f'
+    db '505152535455565758595a5b5c5d5e5f'
+    db '606162636465666768696a6b6c6d6e6f'
+    db '707172737475767778797a7b7c7d7e7f'
+    db '808182838485868788898a8b8c8d8e8f'
+    db '909192939495969798999a9b9c9d9e9f'
+    db 'a0a1a2a3a4a5a6a7a8a9aaabacadaeaf'
+    db 'b0b1b2b3b4b5b6b7b8b9babbbcbdbebf'
+    db 'c0c1c2c3c4c5c6c7c8c9cacbcccdcecf'
+    db 'd0d1d2d3d4d5d6d7d8d9dadbdcdddedf'
+    db 'e0e1e2e3e4e5e6e7e8e9eaebecedeeef'
+    db 'f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff'
+
+section .bss
+alignb 8
+io.used:
+    resq 1
+io.inPos:
+    resq 1
+io.inEnd:
+    resq 1
+io.inputDone:
+    resq 1
+io.ended:
+    resq 1
+io.buffer:
+    resb 65536
+io.input:
+    resb 65536
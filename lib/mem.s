@@ -0,0 +1,287 @@
+; vim: set syntax=nasm:
+
+; The heap behind new and delete, built on mmap without libc.
+;
+; Every block starts with an 8 byte header and new returns the address
+; right after it. Blocks of up to 2048 bytes, header included, are rounded
+; up to a power of two of at least 16. There is a list of free blocks for
+; each of these 8 size classes, the header of a block is its size. Larger
+; blocks have a mapping of their own, given back by delete, their header
+; is the size of the mapping plus 1. While an arena is open new bumps
+; blocks out of the arena instead, their header is 0 and delete leaves
+; them alone, endArena frees all of them at once.
+;
+; Size class blocks and the arena are bumped out of chunks of at least
+; 1 MB. A chunk starts with the previous chunk and its own size.
+;
+; Memory from new is zeroed like globals are.
+
+section .text
+
+mem.alloc:
+    ; bytes = count * size + the header, rounded up to 8
+    mov rax, [rsp+8]
+    test rax, rax
+    js mem.outOfMemory
+    mul QWORD [rsp+16]
+    jc mem.outOfMemory
+    add rax, 15
+    jc mem.outOfMemory
+    and rax, -8
+    mov rcx, rax
+
+    inc QWORD [mem.stats.allocations]
+    cmp QWORD [mem.arenaTop], 0
+    jne .arena
+    cmp rcx, 2048
+    ja .large
+    ; a free block holds the next one after its header
+    cmp rcx, 16
+    jae .class
+    mov rcx, 16
+
+.class:
+    ; the size class is the smallest power of two that fits
+    lea rdx, [rcx-1]
+    bsr rdx, rdx
+    lea rcx, [rdx+1]
+    mov rax, 1
+    shl rax, cl
+    mov rcx, rax
+    sub rdx, 3
+
+    mov rax, [mem.freeLists+rdx*8]
+    test rax, rax
+    jz .bump
+    mov rsi, [rax+8]
+    mov [mem.freeLists+rdx*8], rsi
+    jmp .small
+.bump:
+    mov rbx, mem.heap
+    call mem.bump
+.small:
+    mov [rax], rcx
+    add [mem.stats.inUse], rcx
+    jmp .zero
+
+.arena:
+    mov rbx, mem.arena
+    call mem.bump
+    mov QWORD [rax], 0
+
+.zero:
+    mov rdx, rax
+    lea rdi, [rax+8]
+    shr rcx, 3
+    dec rcx
+    xor eax, eax
+    rep stosq
+    lea rax, [rdx+8]
+    jmp .peak
+
+.large:
+    ; a fresh mapping is already zeroed
+    add rcx, 4095
+    and rcx, -4096
+    mov rsi, rcx
+    call mem.map
+    lea rcx, [rsi+1]
+    mov [rax], rcx
+    add [mem.stats.inUse], rsi
+    add rax, 8
+
+.peak:
+    mov rcx, [mem.stats.inUse]
+    cmp rcx, [mem.stats.peak]
+    jbe .done
+    mov [mem.stats.peak], rcx
+.done:
+    ret
+
+
+mem.free:
+    mov rax, [rsp+8]
+    test rax, rax
+    jz .done
+    sub rax, 8
+    mov rcx, [rax]
+    inc QWORD [mem.stats.frees]
+    test rcx, rcx
+    jz .done
+    test rcx, 1
+    jnz .large
+
+    sub [mem.stats.inUse], rcx
+    bsr rdx, rcx
+    sub rdx, 4
+    mov rsi, [mem.freeLists+rdx*8]
+    mov [rax+8], rsi
+    mov [mem.freeLists+rdx*8], rax
+.done:
+    ret
+
+.large:
+    dec rcx
+    sub [mem.stats.inUse], rcx
+    mov rdi, rax
+    mov rsi, rcx
+    jmp mem.unmap
+
+
+; The mark of an arena is a block at its start, pointing to the mark of the
+; enclosing arena, and holding the chunk it is in and the end of that chunk
+mem.beginArena:
+    mov rbx, mem.arena
+    mov rcx, 24
+    call mem.bump
+    mov rdx, [mem.arenaTop]
+    mov [rax], rdx
+    mov rdx, [mem.arena+16]
+    mov [rax+8], rdx
+    mov rdx, [mem.arena+8]
+    mov [rax+16], rdx
+    mov [mem.arenaTop], rax
+    ret
+
+
+mem.endArena:
+    mov rdx, [mem.arenaTop]
+    test rdx, rdx
+    jz .done
+    mov rbx, [rdx+8]
+
+    ; chunks added since the mark go back to the system
+.unmap:
+    mov rdi, [mem.arena+16]
+    cmp rdi, rbx
+    je .reset
+    mov rax, [rdi]
+    mov [mem.arena+16], rax
+    mov rsi, [rdi+8]
+    call mem.unmap
+    jmp .unmap
+
+.reset:
+    mov [mem.arena], rdx
+    mov rax, [rdx+16]
+    mov [mem.arena+8], rax
+    mov rax, [rdx]
+    mov [mem.arenaTop], rax
+.done:
+    ret
+
+
+mem.allocations:
+    mov rax, [mem.stats.allocations]
+    ret
+
+mem.frees:
+    mov rax, [mem.stats.frees]
+    ret
+
+mem.inUse:
+    mov rax, [mem.stats.inUse]
+    ret
+
+mem.peakInUse:
+    mov rax, [mem.stats.peak]
+    ret
+
+mem.mapped:
+    mov rax, [mem.stats.mapped]
+    ret
+
+
+; Takes rcx bytes from the chunks of the allocator in rbx, a block of its
+; next free byte, the end of its chunk and the chunk. Returns the address
+; in rax, keeps rbx and rcx.
+mem.bump:
+    mov rax, [rbx]
+    lea rdx, [rax+rcx]
+    cmp rdx, [rbx+8]
+    ja .chunk
+    mov [rbx], rdx
+    ret
+
+.chunk:
+    lea rsi, [rcx+16+4095]
+    and rsi, -4096
+    cmp rsi, 1024*1024
+    jae .map
+    mov rsi, 1024*1024
+.map:
+    call mem.map
+    mov rdx, [rbx+16]
+    mov [rax], rdx
+    mov [rax+8], rsi
+    mov [rbx+16], rax
+    lea rdx, [rax+rsi]
+    mov [rbx+8], rdx
+    add rax, 16
+    lea rdx, [rax+rcx]
+    mov [rbx], rdx
+    ret
+
+
+; Maps rsi bytes, returns the address in rax, keeps rbx, rcx and rsi
+mem.map:
+    push rcx
+    mov rax, 9
+    mov rdi, 0
+    mov rdx, 3      ; PROT_READ | PROT_WRITE
+    mov r10, 0x22   ; MAP_PRIVATE | MAP_ANONYMOUS
+    mov r8, -1
+    mov r9, 0
+    syscall
+    pop rcx
+    cmp rax, -4096
+    ja mem.outOfMemory
+    add [mem.stats.mapped], rsi
+    ret
+
+
+; Unmaps rsi bytes at rdi, keeps rbx and rdx
+mem.unmap:
+    mov rax, 11
+    syscall
+    sub [mem.stats.mapped], rsi
+    ret
+
+
+mem.outOfMemory:
+    mov rax, 1
+    mov rdi, 2
+    mov rsi, mem.message
+    mov rdx, 14
+    syscall
+    mov rax, 60
+    mov rdi, 1
+    syscall
+
+
+section .data
+mem.message:
+    db 'Out of memory', 10
+
+section .bss
+alignb 8
+; The next free byte, the end of the chunk and the chunk
+mem.heap:
+    resq 3
+mem.arena:
+    resq 3
+mem.arenaTop:
+    resq 1
+mem.freeLists:
+    resq 8
+mem.stats:
+.allocations:
+    resq 1
+.frees:
+    resq 1
+.inUse:
+    resq 1
+.peak:
+    resq 1
+.mapped:
+    resq 1
@@ -1,247 +1,325 @@
-#include <iostream>
+#include <algorithm>
 #include <fstream>
-#include <memory>
-#include <string>
+#include <iostream>
 #include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 #include <limits.h>
-#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
-#include "AST.h"
+#include "Compiler.h"
 #include "Flags.h"
-#include "cgen.h"
+#include "Parallel.h"
 
 using namespace std;
 
-string readFile(const string& workingDir, const string& fileName)
+string getWorkingDir()
 {
-    ifstream input((workingDir + fileName).c_str());
-
-    if (!input.is_open()) {
-        cerr << "Failed to find file: " << fileName;
-        cerr << " in " << workingDir << endl;
+    char dir[PATH_MAX];
+    if (getcwd(dir, sizeof(dir)) == NULL) {
+        perror("Failed to get working directory: ");
         exit(1);
     }
+    return string(dir) + '/';
+}
+
+void printDiagnostics(ostream& err, const vector<Diagnostic>& diagnostics)
+{
+    bool inSource = false;
+
+    for (const Diagnostic& diagnostic : diagnostics) {
+        err << diagnostic.toString();
+        inSource = inSource || diagnostic.line != 0;
+    }
+
+    if (inSource) {
+        err << "Compilation failed." << endl;
+    }
+}
+
+// Compiles the program at input into the executable output, returns the
+// exit status. The stats of the compilation are returned in statsJSON.
+int compileProgram(const CompileFlags& flags, const string& workingDir,
+                   const string& input, const string& output,
+                   FileSystem& files, ModuleCache* modules,
+                   ostream& out, ostream& err, string& statsJSON)
+{
+    CompileOptions options;
+    options.eliminateTailCalls = flags.eliminateTailCalls;
+    options.skipUnreachable = flags.skipUnreachable;
+    options.wholeProgram = flags.wholeProgram;
+    options.dataAlignment = flags.dataAlignment;
+    options.unbuffered = flags.unbuffered;
+    options.libDir = flags.libDir;
+    options.cacheDir = flags.cacheDir;
+    options.modules = modules;
+    if (flags.printAST) {
+        options.astOutput = &out;
+    }
 
-    char* buffer;
-    int size;
+    CompilerSession session(options, files);
 
-    input.seekg(0, ios::end);
-    size = input.tellg();
-    input.seekg(0, ios::beg);
+    string inputDir = input[0] == '/' ? "" : workingDir;
 
-    buffer = new char[size+1];
+    bool compiled = session.compile(input, inputDir) && session.link(output);
 
-    input.read(buffer, size);
-    input.close();
+    CompileStats stats = session.getStats();
+    statsJSON = "{\"input\": " + jsonString(input) + ", \"compiled\": " +
+                (compiled ? "true" : "false") + ", \"stats\": " +
+                stats.toJSON() + "}";
 
-    buffer[size] = '\0';
+    if (!compiled) {
+        printDiagnostics(err, session.getDiagnostics());
+        return 1;
+    }
 
-    string sourceCode(buffer);
+    // The assembly is kept next to the executable for inspection
+    if (flags.cacheDir.empty()) {
+        ofstream assembly((output + ".s").c_str(), ios::trunc);
+        assembly << session.getAssembly();
+    }
+
+    if (flags.cacheStats) {
+        const CacheStats& cacheStats = session.getCacheStats();
+        out << "Object cache: " << cacheStats.hits << " hits, ";
+        out << cacheStats.misses << " misses, ";
+        out << cacheStats.interfaces << " modules loaded from interfaces" << endl;
+    }
 
-    delete[] buffer;
+    if (flags.timePasses) {
+        out << "Compile time of " << input << ":" << endl;
+        out << stats.toString();
+    }
 
-    return move(sourceCode);
+    return 0;
 }
 
-void assembleAndLink()
+// Name of the executable compiled from an input file
+string getProgramName(const string& input)
 {
-    pid_t pid;
-    
-    pid = fork();
-    if (pid == 0) {
-        execlp("nasm", "nasm", "-f", "elf64", "output.s", NULL);
-        perror("Failed to execute nasm: ");
-        exit(1);
-    } else if (pid > 0) {
-        int status;
-        waitpid(pid, &status, 0);
-        if (WEXITSTATUS(status) != 0) {
-            cerr << "Assemble failed." << endl;
-            exit(1);
-        }
-    } else {
-        perror("Failed to fork nasm: ");
-        exit(1);
+    string name = input.substr(input.find_last_of('/') + 1);
+    if (name.length() > 2 && name.substr(name.length()-2) == ".u") {
+        name = name.substr(0, name.length()-2);
     }
-    
-    pid = fork();
-    if (pid == 0) {
-        execlp("ld", "ld", "-o", "output", "output.o", NULL);
-        perror("Failed to execute ld: ");
-        exit(1);
-    } else if (pid > 0) {
-        int status;
-        waitpid(pid, &status, 0);
-        if (WEXITSTATUS(status) != 0) {
-            cerr << "Link failed." << endl;
-            exit(1);
-        }
-    } else {
-        perror("Failed to fork ld: ");
-        exit(1);
+    return name;
+}
+
+// Writes the stats of every program as a JSON array
+bool writeStats(const string& path, const vector<string>& stats, ostream& err)
+{
+    ofstream file(path.c_str(), ios::trunc);
+
+    file << "[";
+    for (size_t i = 0; i < stats.size(); i++) {
+        file << (i == 0 ? "\n  " : ",\n  ") << stats[i];
+    }
+    file << "\n]\n";
+    file.close();
+
+    if (!file) {
+        err << "Failed to write stats to " << path << endl;
+        return false;
     }
+    return true;
 }
 
-char** getLines(string sourceStr)
+// Compiles every input file, returns the exit status. In a batch the
+// library modules are shared by all programs and the programs are compiled
+// in parallel, their output is written in the order of the inputs.
+int compileAll(const CompileFlags& flags, const string& workingDir,
+               FileSystem& files, ModuleCache& modules,
+               ostream& out, ostream& err)
 {
-    char* source = new char[sourceStr.length()+1];
-    char** lines;
-    int lineCount = 0;
-
-    for (int i = 0; i < sourceStr.length(); i++) {
-        source[i] = sourceStr[i];
-        if (source[i] == '\n') {
-            lineCount++;
+    if (flags.outputDir.empty()) {
+        vector<string> stats(1);
+        int status = compileProgram(flags, workingDir,
+                                    flags.inputFileNames[0],
+                                    workingDir + "output", files, &modules,
+                                    out, err, stats[0]);
+        if (!flags.statsFile.empty() &&
+                !writeStats(flags.statsFile, stats, err)) {
+            return 1;
         }
+        return status;
     }
 
-    lines = new char*[lineCount+1];
+    if (mkdir(flags.outputDir.c_str(), 0755) != 0 && errno != EEXIST) {
+        err << "Failed to create output directory: " << strerror(errno);
+        err << endl;
+        return 1;
+    }
 
-    char* lineStart = source;
-    int line = 0;
+    size_t count = flags.inputFileNames.size();
+    set<string> names;
 
-    for (int i = 0; i < sourceStr.length(); i++) {
-        if (source[i] == '\n') {
-            source[i] = '\0';
-            lines[line] = lineStart;
-            lineStart = &source[i+1];
-            line++;
+    for (const string& input : flags.inputFileNames) {
+        if (!names.insert(getProgramName(input)).second) {
+            err << "Two input files compile to the same program: ";
+            err << getProgramName(input) << endl;
+            return 1;
         }
     }
 
-    lines[line] = lineStart;
-    source[sourceStr.length()] = '\0';
+    vector<ostringstream> outputs(count);
+    vector<ostringstream> errors(count);
+    vector<int> statuses(count);
+    vector<string> stats(count);
+
+    parallelFor(count, [&](size_t i) {
+        const string& input = flags.inputFileNames[i];
+        statuses[i] = compileProgram(flags, workingDir, input,
+                                     flags.outputDir + getProgramName(input),
+                                     files, &modules, outputs[i], errors[i],
+                                     stats[i]);
+    });
+
+    int status = 0;
+    for (size_t i = 0; i < count; i++) {
+        out << outputs[i].str();
+        err << errors[i].str();
+        status = max(status, statuses[i]);
+    }
 
-    return lines;
+    if (!flags.statsFile.empty() && !writeStats(flags.statsFile, stats, err)) {
+        return 1;
+    }
+    return status;
 }
 
-string getModuleName(string filePath)
+//
+// Compile server
+//
+// With --server <socket> the compiler listens on a Unix domain socket and
+// compiles one program for every connection, see client.cpp. Library
+// modules are kept between compilations.
+//
+// A request is the working directory of the client followed by its
+// arguments, each terminated by a NUL. The response is the exit status and
+// the lengths of the standard output and error text, one per line,
+// followed by the text itself.
+//
+
+void serveClient(int client, FileSystem& files, ModuleCache& modules)
 {
-    size_t slash = filePath.find_last_of('/');
-    if (slash != string::npos) {
-        filePath = filePath.substr(slash+1);
+    string request;
+    char buffer[4096];
+    ssize_t count;
+
+    while ((count = read(client, buffer, sizeof(buffer))) > 0) {
+        request.append(buffer, count);
     }
-    return filePath.substr(0, filePath.length());
-}
 
-string getModuleDir(const string& workingDir, const string& filePath)
-{
-    string basePath;
+    vector<string> args;
+    size_t start = 0;
+    size_t end;
+    while ((end = request.find('\0', start)) != string::npos) {
+        args.push_back(request.substr(start, end-start));
+        start = end+1;
+    }
 
-    if (access((workingDir + filePath).c_str(), F_OK) != -1) {
-        basePath = workingDir + filePath;
+    ostringstream out;
+    ostringstream err;
+    int status = 1;
+
+    if (args.empty()) {
+        err << "Invalid request." << endl;
     } else {
-        if (access((Flags::libDir + filePath).c_str(), F_OK) == -1) {
-            cerr << "Failed to locate module: " << filePath << endl;
-            cerr << "Working directory: " << workingDir << endl;
-            cerr << "Library directory: " << Flags::libDir << endl;
-            exit(1);
+        string workingDir = args[0];
+        args.erase(args.begin());
+
+        CompileFlags flags;
+        string error;
+        if (parseCompileFlags(args, workingDir, flags, error)) {
+            status = compileAll(flags, workingDir, files, modules, out, err);
         } else {
-            basePath = Flags::libDir + filePath;
+            err << error << endl;
         }
     }
 
-    size_t slash = basePath.find_last_of('/');
+    string response = to_string(status) + "\n" +
+                      to_string(out.str().length()) + "\n" +
+                      to_string(err.str().length()) + "\n" +
+                      out.str() + err.str();
 
-    if (slash != string::npos) {
-        basePath = basePath.substr(0, slash+1);
-    } else {
-        basePath = "./";
+    for (size_t sent = 0; sent < response.length(); sent += count) {
+        count = write(client, response.data() + sent,
+                      response.length() - sent);
+        if (count <= 0) {
+            break;
+        }
     }
 
-    return basePath;
-}
-
-string getWorkingDir()
-{
-    char dir[PATH_MAX];
-    if (getcwd(dir, sizeof(dir)) == NULL) {
-        perror("Failed to get working directory: ");
-        exit(1);
-    }
-    return string(dir) + '/';
+    close(client);
 }
 
-void compile(string workingDir, string moduleName,
-             ostream& assemblyOutput, SymbolTable& symbols)
+int runServer(const string& socketPath)
 {
-    static set<string> importedModules;
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
 
-    string sourceCode = readFile(workingDir, moduleName+".u");
+    if (socketPath.length() >= sizeof(address.sun_path)) {
+        cerr << "Socket path too long: " << socketPath << endl;
+        return 1;
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+
+    // Compilations fork nasm and ld, which mustn't hold other clients'
+    // connections open
+    int server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server < 0) {
+        perror("Failed to create socket: ");
+        return 1;
+    }
 
-    unique_ptr<ModuleNode> ast(parse(sourceCode, moduleName));
+    // Replace the socket of a server that is no longer running
+    unlink(socketPath.c_str());
 
-    if (Flags::printAST) {
-        cout << ast->toString() << endl;
+    if (bind(server, (sockaddr*)&address, sizeof(address)) != 0 ||
+            listen(server, SOMAXCONN) != 0) {
+        perror(("Failed to listen on " + socketPath + ": ").c_str());
+        return 1;
     }
 
-    for (Import& import : ast->imports) {
-        if (import.isAssembly) {
-            string importPath = workingDir+import.path.str+".s";
-            if (importedModules.find(importPath) != importedModules.end()) {
-                continue;
-            }
-            importedModules.insert(importPath);
-            assemblyOutput << ";; " << import.path.str << " ;;" << endl;
+    // Clients that go away before their response is written are ignored
+    signal(SIGPIPE, SIG_IGN);
 
-            assemblyOutput << readFile(workingDir, import.path.str+".s") << endl;
-        } else {
-            string newModuleName = getModuleName(import.path.str);
-            string newWorkingDir = getModuleDir(workingDir, import.path.str+".u");
+    DiskFileSystem files;
+    ModuleCache modules;
 
-            string importPath = newWorkingDir + newModuleName;
-            if (importedModules.find(importPath) != importedModules.end()) {
+    while (true) {
+        int client = accept4(server, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR) {
                 continue;
             }
-            importedModules.insert(importPath);
-            assemblyOutput << ";; " << import.path.str << " ;;" << endl;
-
-            compile(newWorkingDir, newModuleName, assemblyOutput, symbols);
+            perror("Failed to accept connection: ");
+            return 1;
         }
-    }
-    
-    ast->sourceLines = getLines(sourceCode);
-
-    string errors = ast->validate(symbols);
 
-    if (errors.length() > 0) {
-        cerr << errors;
-        cerr << "Compilation failed." << endl;
-        exit(1);
+        thread(serveClient, client, ref(files), ref(modules)).detach();
     }
-    
-    delete[] ast->sourceLines[0];
-    delete[] ast->sourceLines;
-
-    ast->cgen(assemblyOutput);
 }
 
 int main(int argc, char** argv)
 {
-    parseFlags(argc, argv);
-
-    string moduleName = getModuleName(Flags::inputFileName);
-    moduleName = moduleName.substr(0, moduleName.length()-2);
+    CompileFlags flags = parseFlags(argc, argv);
 
-    ofstream out("output.s", ios::trunc);
-    if (!out) {
-        cerr << "Failed to open output.s" << endl;
-        exit(1);
+    if (!Flags::serverSocket.empty()) {
+        return runServer(Flags::serverSocket);
     }
 
-    startAsm(out, moduleName);
-
-    SymbolTable symbols;
-
-    string dir = getModuleDir(getWorkingDir(), Flags::inputFileName);
-    compile(dir, moduleName, out, symbols);
-
-    out.close();
-
-    assembleAndLink();
-
-    return 0;
+    DiskFileSystem files;
+    ModuleCache modules;
+    return compileAll(flags, getWorkingDir(), files, modules, cout, cerr);
 }
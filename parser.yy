@@ -1,18 +1,19 @@
 %{
 
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
 #include "AST.h"
 
-extern ModuleNode* module;
-
-extern int yylex(void);
-
-int yyerror(const char*);
-
 #define YYDEBUG 1
 #define YYERROR_VERBOSE
 
 %}
 
+%define api.pure full
+%lex-param {void* scanner}
+%parse-param {void* scanner} {ParseContext* context}
+
 %union {
     ModuleNode*    module;
     FunctionNode*  function;
@@ -20,6 +21,9 @@ int yyerror(const char*);
     Block*         block;
     Statement*     statement;
     If*            else_chain;
+    SwitchCase*    switch_case;
+    Block*         default_case;
+    long           case_value;
     Expression*    expression;
     Symbol*        symbol;
     SourceText*    source_text;
@@ -27,10 +31,39 @@ int yyerror(const char*);
     Type*          type;
     vector<Symbol>* id_list;
     vector<Import>* import_list;
-    vector<unique_ptr<Declaration>>*  argument_list;
-    vector<unique_ptr<Statement>>*    statement_list;
-    vector<unique_ptr<Expression>>*   expr_list;
-    vector<shared_ptr<FunctionNode>>* function_list;
+    vector<Declaration*>*  argument_list;
+    vector<Statement*>*    statement_list;
+    vector<Expression*>*   expr_list;
+    vector<SwitchCase*>*   case_list;
+    vector<long>*          case_values;
+    vector<FunctionNode*>* function_list;
+}
+
+%code {
+
+extern int yylex(YYSTYPE*, void*);
+
+int yyerror(void*, ParseContext*, const char*);
+
+// The value of a decimal literal, false if it is larger than limit
+static bool numberValue(const SourceText& text, unsigned long limit,
+                        unsigned long& value)
+{
+    errno = 0;
+    value = strtoul(text.str.c_str(), NULL, 10);
+    return errno == 0 && value <= limit;
+}
+
+static void rangeError(ParseContext* context, SourceLocation location)
+{
+    if (!context->failed) {
+        context->failed = true;
+        context->error.line = location.line;
+        context->error.column = location.column;
+        context->error.message = "Number out of range";
+    }
+}
+
 }
 
 %type <module> module
@@ -39,12 +72,18 @@ int yyerror(const char*);
 %type <block> block
 %type <statement> statement
 %type <else_chain> else_chain
+%type <switch_case> switch_case
+%type <case_list> case_list
+%type <case_values> case_values
+%type <case_value> case_value
+%type <default_case> default_case
 %type <expression> expr
 %type <expression> expr2
 %type <argument_list> argument_list
 %type <argument_list> actual_argument_list
 %type <statement_list> statement_list
 %type <expr_list> expr_list
+%type <expr_list> initializer
 %type <id_list> id_list
 %type <import_list> imports
 %type <function_list> function_list
@@ -57,12 +96,17 @@ int yyerror(const char*);
 %token<location> ELSE
 %token<location> EXTERN
 %token<location> VAR
+%token<location> CONST
+%token<location> NEW
+%token<location> DELETE
 %token<location> IMPORT
 %token<location> ASM
 %token<location> RETURN
 %token<location> FOR
 %token<location> IN
 %token<location> DOTDOT
+%token<location> SWITCH
+%token<location> CASE
 
 %token<location> EQUAL
 %token<location> NOT_EQUAL
@@ -95,10 +139,23 @@ module:
     imports function_list
     {
         if ($1 != nullptr) {
-            module->imports = *$1;
+            context->module->imports = *$1;
+            delete $1;
         }
-        module->functions = *$2;
-        $$ = module;
+        context->module->functions = *$2;
+        delete $2;
+
+        if (!context->minimumLiterals.empty()) {
+            rangeError(context, context->minimumLiterals[0]->location);
+            YYABORT;
+        }
+
+        // new and delete call the mem module of the library
+        if (context->usesHeap) {
+            context->module->imports.push_back(
+                Import{SourceText{context->location, "mem"}, false, true});
+        }
+        $$ = context->module;
     }
 ;
 
@@ -109,14 +166,12 @@ imports:
     }
 |   imports IMPORT STRING_CONSTANT ';'
     {
-        $1->push_back(Import{*$3, false});
-        delete $3;
+        $1->push_back(Import{*$3, false, false});
         $$ = $1;
     }
 |   imports IMPORT ASM STRING_CONSTANT ';'
     {
-        $1->push_back(Import{*$4, true});
-        delete $4;
+        $1->push_back(Import{*$4, true, false});
         $$ = $1;
     }
 ;
@@ -124,12 +179,59 @@ imports:
 function_list:
     function
     {
-        $$ = new vector<shared_ptr<FunctionNode>>();
-        $$->push_back(shared_ptr<FunctionNode>($1));
+        $$ = new vector<FunctionNode*>();
+        $$->push_back($1);
+    }
+|   global
+    {
+        $$ = new vector<FunctionNode*>();
     }
 |   function_list function
     {
-        $1->push_back(shared_ptr<FunctionNode>($2));
+        $1->push_back($2);
+    }
+|   function_list global
+    {
+        $$ = $1;
+    }
+;
+
+global:
+    VAR id_list type ';'
+    {
+        Global* global = context->arena->make<Global>(
+            $3, *$2, vector<Expression*>(), false);
+        global->location = $1;
+        context->module->globals.push_back(global);
+        delete $2;
+    }
+|   VAR id_list type '=' initializer ';'
+    {
+        Global* global = context->arena->make<Global>($3, *$2, *$5, false);
+        global->location = $1;
+        context->module->globals.push_back(global);
+        delete $2;
+        delete $5;
+    }
+|   CONST id_list type '=' initializer ';'
+    {
+        Global* global = context->arena->make<Global>($3, *$2, *$5, true);
+        global->location = $1;
+        context->module->globals.push_back(global);
+        delete $2;
+        delete $5;
+    }
+;
+
+initializer:
+    expr
+    {
+        $$ = new vector<Expression*>();
+        $$->push_back($1);
+    }
+|   '{' expr_list '}'
+    {
+        $$ = $2;
     }
 ;
 
@@ -147,27 +249,25 @@ qid:
 function:
     type ID '(' argument_list ')' block
     {
-        $$ = new FunctionNode();
+        $$ = context->arena->make<FunctionNode>();
         if ($4 != nullptr) {
-            $$->arguments = move(*$4);
+            $$->arguments = *$4;
             delete $4;
         }
-        $$->block.reset($6);
+        $$->block = $6;
         $$->id = *$2;
-        delete $2;
-        $$->returnType.reset($1);
+        $$->returnType = $1;
         $$->location = $1->location;
     }
 |   EXTERN type ID '(' argument_list ')' ';'
     {
-        $$ = new FunctionNode();
+        $$ = context->arena->make<FunctionNode>();
         if ($5 != nullptr) {
-            $$->arguments = move(*$5);
+            $$->arguments = *$5;
             delete $5;
         }
         $$->id = *$3;
-        delete $3;
-        $$->returnType.reset($2);
+        $$->returnType = $2;
         $$->location = $1;
     }
 ;
@@ -175,17 +275,20 @@ function:
 type:
     ID
     {
-        $$ = new BasicType(*$1);
-        delete $1;
+        $$ = context->arena->make<BasicType>(*$1);
     }
 |   type '[' NUMBER ']'
     {
         int size = atoi($3->str.c_str());
-        $$ = new ArrayType(unique_ptr<Type>($1), size);
+        $$ = context->arena->make<ArrayType>($1, size);
+    }
+|   type '[' ']'
+    {
+        $$ = context->arena->make<ArrayType>($1, 0);
     }
 |   type '*'
     {
-        $$ = new PointerType(unique_ptr<Type>($1));
+        $$ = context->arena->make<PointerType>($1);
     }
 ;
 
@@ -205,20 +308,16 @@ actual_argument_list:
     {
         vector<Symbol> syms;
         syms.push_back(*$2);
-        unique_ptr<Declaration> decl(new Declaration($1, syms));
-        delete $2;
 
-        $$ = new vector<unique_ptr<Declaration>>();
-        $$->push_back(move(decl));
+        $$ = new vector<Declaration*>();
+        $$->push_back(context->arena->make<Declaration>($1, syms));
     }
 |   argument_list ',' type ID
     {
         vector<Symbol> syms;
         syms.push_back(*$4);
-        unique_ptr<Declaration> decl(new Declaration($3, syms));
-        delete $4;
 
-        $1->push_back(move(decl));
+        $1->push_back(context->arena->make<Declaration>($3, syms));
         $$ = $1;
     }
 ;
@@ -226,8 +325,8 @@ actual_argument_list:
 block:
     '{' statement_list '}'
     {
-        $$ = new Block();
-        $$->statements = move(*$2);
+        $$ = context->arena->make<Block>();
+        $$->statements = *$2;
         // TODO: location
         delete $2;
     }
@@ -236,11 +335,11 @@ block:
 statement_list:
     /* empty */
     {
-        $$ = new vector<unique_ptr<Statement>>();
+        $$ = new vector<Statement*>();
     }
 |   statement_list statement
     {
-        $1->push_back(unique_ptr<Statement>($2));
+        $1->push_back($2);
         $$ = $1;
     }
 ;
@@ -248,22 +347,22 @@ statement_list:
 statement:
     VAR id_list type ';'
     {
-        $$ = new Declaration($3, *$2);
+        $$ = context->arena->make<Declaration>($3, *$2);
         $$->location = $1;
         delete $2;
     }
 |   expr '=' expr ';'
     {
-        Assignment* ass = new Assignment();
-        ass->lhs.reset($1);
-        ass->rhs.reset($3);
+        Assignment* ass = context->arena->make<Assignment>();
+        ass->lhs = $1;
+        ass->rhs = $3;
         ass->location = $1->location;
 
         $$ = ass;
     }
 |   RETURN expr ';'
     {
-        $$ = new Return($2);
+        $$ = context->arena->make<Return>($2);
         $$->location = $1;
     }
 |   function_call ';'
@@ -272,25 +371,43 @@ statement:
     }
 |   WHILE '(' expr ')' block
     {
-        $$ = new While($3, $5);
+        $$ = context->arena->make<While>($3, $5);
         $$->location = $1;
     }
 |   IF '(' expr ')' block else_chain
     {
-        $$ = new If($3, $5, $6);
+        $$ = context->arena->make<If>($3, $5, $6);
         $$->location = $1;
     }
+|   SWITCH '(' expr ')' '{' case_list default_case '}'
+    {
+        $$ = context->arena->make<Switch>($3, *$6, $7);
+        $$->location = $1;
+        delete $6;
+    }
+|   DELETE expr ';'
+    {
+        FunctionCall* call = context->arena->make<FunctionCall>();
+        call->id = Symbol($1, "mem", "free");
+        call->builtin = BUILTIN_DELETE;
+        call->arguments.push_back($2);
+        call->Statement::location = $1;
+        context->usesHeap = true;
+        $$ = call;
+    }
 |   FOR '(' type ID IN expr DOTDOT expr ')' block
     {
-        $$ = new RangeFor($3, *$4, $6, $8, $10);
+        vector<Symbol> ids(1, *$4);
+        Declaration* decl = context->arena->make<Declaration>($3, ids);
+        $$ = context->arena->make<RangeFor>(decl, $6, $8, $10);
         $$->location = $1;
-        delete $4;
     }
 |   FOR '(' type ID IN expr ')' block
     {
-        $$ = new ArrayFor($3, *$4, $6, $8);
+        vector<Symbol> ids(1, *$4);
+        Declaration* decl = context->arena->make<Declaration>($3, ids);
+        $$ = context->arena->make<ArrayFor>(decl, $6, $8);
         $$->location = $1;
-        delete $4;
     }
 ;
 
@@ -299,7 +416,6 @@ id_list:
     {
         $$ = new vector<Symbol>();
         $$->push_back(*$1);
-        delete $1;
     }
 |   id_list ',' ID
     {
@@ -315,100 +431,163 @@ else_chain:
     }
 |   ELIF '(' expr ')' block else_chain
     {
-        $$ = new If($3, $5, $6);
+        $$ = context->arena->make<If>($3, $5, $6);
         $$->location = $1;
     }
 |   ELSE block
     {
-        $$ = new If(nullptr, $2, NULL);
+        $$ = context->arena->make<If>(nullptr, $2, nullptr);
+        $$->location = $1;
+    }
+;
+
+case_list:
+    /* empty */
+    {
+        $$ = new vector<SwitchCase*>();
+    }
+|   case_list switch_case
+    {
+        $1->push_back($2);
+        $$ = $1;
+    }
+;
+
+switch_case:
+    CASE case_values block
+    {
+        $$ = context->arena->make<SwitchCase>(*$2, $3);
         $$->location = $1;
+        delete $2;
+    }
+;
+
+case_values:
+    case_value
+    {
+        $$ = new vector<long>();
+        $$->push_back($1);
+    }
+|   case_values ',' case_value
+    {
+        $1->push_back($3);
+        $$ = $1;
+    }
+;
+
+case_value:
+    NUMBER
+    {
+        unsigned long value;
+        if (!numberValue(*$1, LONG_MAX, value)) {
+            rangeError(context, $1->location);
+            YYABORT;
+        }
+        $$ = value;
+    }
+|   '-' NUMBER
+    {
+        unsigned long value;
+        if (!numberValue(*$2, (unsigned long)LONG_MAX + 1, value)) {
+            rangeError(context, $2->location);
+            YYABORT;
+        }
+        $$ = (long)-value;
+    }
+;
+
+default_case:
+    /* empty */
+    {
+        $$ = nullptr;
+    }
+|   ELSE block
+    {
+        $$ = $2;
     }
 ;
 
 function_call:
     qid '(' expr_list ')'
     {
-        $$ = new FunctionCall();
+        $$ = context->arena->make<FunctionCall>();
         $$->id = *$1;
-        $$->arguments = move(*$3);
+        $$->arguments = *$3;
         $$->Statement::location = $$->id.location;
-        delete $1;
         delete $3;
     }
 |   qid '(' ')'
     {
-        $$ = new FunctionCall();
+        $$ = context->arena->make<FunctionCall>();
         $$->id = *$1;
-        $$->arguments = vector<unique_ptr<Expression>>();
         $$->Statement::location = $$->id.location;
-        delete $1;
     }
 ;
 
 expr_list:
     expr
     {
-        $$ = new vector<unique_ptr<Expression>>();
-        $$->push_back(unique_ptr<Expression>($1));
+        $$ = new vector<Expression*>();
+        $$->push_back($1);
     }
 |   expr_list ',' expr
     {
-        $1->push_back(unique_ptr<Expression>($3));
+        $1->push_back($3);
     }
 ;
 
 expr:
     expr LOGICAL_OR expr
     {
-        $$ = new BinaryOpExpression(OP_LOGICAL_OR, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_LOGICAL_OR, $1, $3);
     }
 |   expr LOGICAL_AND expr
     {
-        $$ = new BinaryOpExpression(OP_LOGICAL_AND, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_LOGICAL_AND, $1, $3);
     }
 |   expr EQUAL expr
     {
-        $$ = new BinaryOpExpression(OP_EQUAL, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_EQUAL, $1, $3);
     }
 |   expr NOT_EQUAL expr
     {
-        $$ = new BinaryOpExpression(OP_NOT_EQUAL, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_NOT_EQUAL, $1, $3);
     }
 |   expr '>' expr
     {
-        $$ = new BinaryOpExpression(OP_GREATER, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_GREATER, $1, $3);
     }
 |   expr GE expr
     {
-        $$ = new BinaryOpExpression(OP_GREATER_EQ, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_GREATER_EQ, $1, $3);
     }
 |   expr '<' expr
     {
-        $$ = new BinaryOpExpression(OP_LESS, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_LESS, $1, $3);
     }
 |   expr LE expr
     {
-        $$ = new BinaryOpExpression(OP_LESS_EQ, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_LESS_EQ, $1, $3);
     }
 |   expr '+' expr
     {
-        $$ = new BinaryOpExpression(OP_ADD, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_ADD, $1, $3);
     }
 |   expr '-' expr
     {
-        $$ = new BinaryOpExpression(OP_SUB, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_SUB, $1, $3);
     }
 |   expr '/' expr
     {
-        $$ = new BinaryOpExpression(OP_DIV, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_DIV, $1, $3);
     }
 |   expr '*' expr
     {
-        $$ = new BinaryOpExpression(OP_MUL, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_MUL, $1, $3);
     }
 |   expr '%' expr
     {
-        $$ = new BinaryOpExpression(OP_MOD, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_MOD, $1, $3);
     }
 |   expr2
     {
@@ -419,9 +598,8 @@ expr:
 expr2:
     ID
     {
-        $$ = new VariableExpression(*$1);
+        $$ = context->arena->make<VariableExpression>(*$1);
         $$->location = $1->location;
-        delete $1;
     }
 |   function_call
     {
@@ -429,45 +607,79 @@ expr2:
     }
 |   NUMBER
     {
-        // TODO: check for out of range literals
-        $$ = new NumericLiteral(atol($1->str.c_str()));
+        unsigned long value;
+        if (!numberValue(*$1, (unsigned long)LONG_MAX + 1, value)) {
+            rangeError(context, $1->location);
+            YYABORT;
+        }
+        $$ = context->arena->make<NumericLiteral>((long)value);
         $$->location = $1->location;
-        delete $1;
+        if (value > LONG_MAX) {
+            context->minimumLiterals.push_back($$);
+        }
     }
 |   STRING_CONSTANT
     {
-        module->strings.push_back($1->str);
-        $$ = new StringLiteral($1->str, module->strings.size()-1);
+        context->module->strings.push_back($1->str);
+        $$ = context->arena->make<StringLiteral>(
+            $1->str, context->module->strings.size()-1);
         $$->location = $1->location;
-        delete $1;
     }
 |   TRUE
     {
-        $$ = new BooleanLiteral(true);
+        $$ = context->arena->make<BooleanLiteral>(true);
         $$->location = $1;
     }
 |   FALSE
     {
-        $$ = new BooleanLiteral(false);
+        $$ = context->arena->make<BooleanLiteral>(false);
         $$->location = $1;
     }
 |   '!' expr2
     {
-        $$ = new UnaryOpExpression(OP_LOGICAL_NOT, $2);
+        $$ = context->arena->make<UnaryOpExpression>(OP_LOGICAL_NOT, $2);
         // TODO: location should be the location of ! not the expression
     }
 |   '-' expr2
     {
-        $$ = new UnaryOpExpression(OP_UNARY_MINUS, $2);
+        // -2^63 is the smallest int, the literal wraps around to it
+        if (!context->minimumLiterals.empty() &&
+                context->minimumLiterals.back() == $2) {
+            context->minimumLiterals.pop_back();
+        }
+        $$ = context->arena->make<UnaryOpExpression>(OP_UNARY_MINUS, $2);
         // TODO: location should be the location of - not the expression
     }
 |   '*' expr2
     {
-        $$ = new UnaryOpExpression(OP_DEREF, $2);
+        $$ = context->arena->make<UnaryOpExpression>(OP_DEREF, $2);
     }
 |   '&' expr2
     {
-        $$ = new UnaryOpExpression(OP_ADDRESS, $2);
+        $$ = context->arena->make<UnaryOpExpression>(OP_ADDRESS, $2);
+    }
+|   NEW '(' type ')'
+    {
+        FunctionCall* call = context->arena->make<FunctionCall>();
+        call->id = Symbol($1, "mem", "alloc");
+        call->builtin = BUILTIN_NEW;
+        call->allocated = $3;
+        call->Statement::location = $1;
+        call->Expression::location = $1;
+        context->usesHeap = true;
+        $$ = call;
+    }
+|   NEW '(' type ',' expr ')'
+    {
+        FunctionCall* call = context->arena->make<FunctionCall>();
+        call->id = Symbol($1, "mem", "alloc");
+        call->builtin = BUILTIN_NEW_ARRAY;
+        call->allocated = $3;
+        call->arguments.push_back($5);
+        call->Statement::location = $1;
+        call->Expression::location = $1;
+        context->usesHeap = true;
+        $$ = call;
     }
 |   '(' expr ')'
     {
@@ -475,14 +687,20 @@ expr2:
     }
 |   expr2 '[' expr ']'
     {
-        $$ = new BinaryOpExpression(OP_ARRAY_ACCESS, $1, $3);
+        $$ = context->arena->make<BinaryOpExpression>(OP_ARRAY_ACCESS, $1, $3);
     }
 ;
 
 %%
 
-int yyerror(char const* str)
+// Only the first error is reported, the parser stops right after it
+int yyerror(void* scanner, ParseContext* context, char const* str)
 {
-    printf("%s\n", str);
-    exit(1);
+    if (!context->failed) {
+        context->failed = true;
+        context->error.line = context->location.line;
+        context->error.column = context->location.column;
+        context->error.message = str;
+    }
+    return 0;
 }
@@ -0,0 +1,156 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/perf_event.h>
+
+using namespace std;
+
+//
+// Runs a program and counts its user space cycles, instructions, branch
+// misses and L1 data cache read misses with perf_event_open. The program's
+// output is left alone, the counts are written as one line of JSON to the
+// file given with -o, or to stderr. A counter the machine doesn't have is
+// written as null, followed by the exit status of the program and the
+// signal that killed it, 0 if none. perf-runner exits with the status of the
+// program, or 128 plus the signal.
+//
+// Usage: perf-runner [-o <file>] <program> [args...]
+//
+
+struct Counter {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+    int fd;
+};
+
+static Counter counters[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1},
+    {"l1d-misses", PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), -1},
+};
+
+static const int counterCount = sizeof(counters) / sizeof(counters[0]);
+
+// Counts the user space events of pid from its next exec on
+static int openCounter(const Counter& counter, pid_t pid)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter.type;
+    attr.config = counter.config;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(SYS_perf_event_open, &attr, pid, -1, -1,
+                   PERF_FLAG_FD_CLOEXEC);
+}
+
+int main(int argc, char** argv)
+{
+    string outputFile;
+    int first = 1;
+
+    if (argc > 2 && string(argv[1]) == "-o") {
+        outputFile = argv[2];
+        first = 3;
+    }
+
+    if (first >= argc) {
+        cerr << "Usage: " << argv[0] << " [-o <file>] <program> [args...]";
+        cerr << endl;
+        return 1;
+    }
+
+    // The child waits until the counters are attached before it execs
+    int ready[2];
+    if (pipe(ready) != 0) {
+        perror("Failed to create pipe: ");
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Failed to fork: ");
+        return 1;
+    }
+
+    if (pid == 0) {
+        char c;
+        close(ready[1]);
+        if (read(ready[0], &c, 1) != 1) {
+            _exit(1);
+        }
+        close(ready[0]);
+        execvp(argv[first], argv + first);
+        perror(("Failed to execute " + string(argv[first]) + ": ").c_str());
+        _exit(127);
+    }
+
+    close(ready[0]);
+
+    for (Counter& counter : counters) {
+        counter.fd = openCounter(counter, pid);
+    }
+
+    if (write(ready[1], "x", 1) != 1) {
+        perror("Failed to start program: ");
+        return 1;
+    }
+    close(ready[1]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            perror("Failed to wait for program: ");
+            return 1;
+        }
+    }
+
+    int exitStatus = WIFEXITED(status) ? WEXITSTATUS(status)
+                                       : 128 + WTERMSIG(status);
+
+    string report = "{";
+    for (int i = 0; i < counterCount; i++) {
+        uint64_t value;
+        string text = "null";
+        if (counters[i].fd >= 0 &&
+                read(counters[i].fd, &value, sizeof(value)) ==
+                    sizeof(value)) {
+            text = to_string(value);
+        }
+        report += string(i == 0 ? "" : ", ") + "\"" + counters[i].name +
+                  "\": " + text;
+    }
+    report += ", \"status\": " + to_string(exitStatus) + ", \"signal\": " +
+              to_string(WIFSIGNALED(status) ? WTERMSIG(status) : 0) + "}\n";
+
+    if (outputFile.empty()) {
+        cerr << report;
+    } else {
+        ofstream out(outputFile.c_str(), ios::trunc);
+        out << report;
+        if (!out) {
+            cerr << "Failed to write " << outputFile << endl;
+            return 1;
+        }
+    }
+
+    return exitStatus;
+}
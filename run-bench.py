@@ -0,0 +1,259 @@
+#!/usr/bin/python
+#
+# Runtime benchmarks of the generated code. Every kernel in tests/bench is
+# compiled, run several times and checked to print PASS last. The median
+# wall time and, when hardware counters are available, the instruction
+# count are compared against tests/bench/baseline.json. Counters are read
+# with perf-runner, or with perf if it hasn't been built.
+#
+# Usage: run-bench.py [options] [kernel.u...]
+#   --runs <n>           runs per kernel, defaults to 5
+#   --threshold <pct>    slowdown over the baseline reported as a regression,
+#                        defaults to 5 for instructions and 15 for time
+#   --update-baseline    store the results as the new baseline
+#   --gcc                also time the C versions in tests/bench/c built with
+#                        gcc -O0 and -O2
+#
+from subprocess import Popen, PIPE, STDOUT
+import json
+import os
+import glob
+import shutil
+import sys
+import tempfile
+import time
+
+def red(text):
+    return '\x1B[31m' + text + '\x1B[0m'
+
+def green(text):
+    return '\x1B[32m' + text + '\x1B[0m'
+
+bench_dir = './tests/bench'
+baseline_file = os.path.join(bench_dir, 'baseline.json')
+output_dir = 'bench-output'
+
+runs = 5
+threshold = None
+update_baseline = False
+compare_gcc = False
+bench_files = []
+
+args = sys.argv[1:]
+while args:
+    arg = args.pop(0)
+    if arg == '--runs':
+        runs = int(args.pop(0))
+    elif arg == '--threshold':
+        threshold = float(args.pop(0))
+    elif arg == '--update-baseline':
+        update_baseline = True
+    elif arg == '--gcc':
+        compare_gcc = True
+    else:
+        bench_files.append(os.path.join(bench_dir, arg))
+
+if not bench_files:
+    bench_files = sorted(glob.glob(os.path.join(bench_dir, '*.u')))
+
+for bench_file in bench_files:
+    if not os.path.exists(bench_file):
+        print(red('File does not exist: ' + bench_file))
+        sys.exit(1)
+
+def have_perf():
+    try:
+        p = Popen(['perf', 'stat', '-x,', '-e', 'instructions:u', 'true'],
+                  stdout=PIPE, stderr=PIPE)
+        err = p.communicate()[1].decode('ASCII', 'replace')
+        return p.returncode == 0 and 'not supported' not in err
+    except OSError:
+        return False
+
+def have_runner():
+    if not os.path.exists('./perf-runner'):
+        return False
+    report = tempfile.NamedTemporaryFile(delete=False)
+    report.close()
+    Popen(['./perf-runner', '-o', report.name, 'true'],
+          stdout=PIPE, stderr=PIPE).communicate()
+    counted = json.load(open(report.name)).get('instructions') is not None
+    os.unlink(report.name)
+    return counted
+
+use_runner = have_runner()
+use_perf = not use_runner and have_perf()
+
+counter_names = ['cycles', 'instructions', 'branch-misses', 'l1d-misses']
+
+def median(values):
+    values = sorted(values)
+    middle = len(values) // 2
+    if len(values) % 2 == 1:
+        return values[middle]
+    return (values[middle-1] + values[middle]) / 2.0
+
+# Runs a program once, returns its wall time in seconds, its counters if
+# they are available, and whether it printed PASS last
+def run_once(program):
+    output = tempfile.TemporaryFile()
+    stat_file = tempfile.NamedTemporaryFile(delete=False)
+    stat_file.close()
+
+    cmd = [program]
+    if use_runner:
+        cmd = ['./perf-runner', '-o', stat_file.name] + cmd
+    elif use_perf:
+        cmd = ['perf', 'stat', '-x,', '-e', 'instructions:u',
+               '-o', stat_file.name, '--'] + cmd
+
+    start = time.time()
+    p = Popen(cmd, stdout=output, stderr=STDOUT)
+    p.wait()
+    elapsed = time.time() - start
+
+    counts = {}
+    if use_runner:
+        try:
+            counts = json.load(open(stat_file.name))
+        except ValueError:
+            pass
+    elif use_perf:
+        for line in open(stat_file.name):
+            fields = line.split(',')
+            if len(fields) > 2 and fields[2].startswith('instructions'):
+                try:
+                    counts['instructions'] = int(fields[0])
+                except ValueError:
+                    pass
+    os.unlink(stat_file.name)
+
+    output.seek(0)
+    lines = output.read().decode('ASCII', 'replace').strip().split('\n')
+    passed = p.returncode >= 0 and lines[-1] == 'PASS'
+
+    return elapsed, counts, passed
+
+# The median of the wall times and of each counter over the runs
+def measure(program):
+    times = []
+    counts = {}
+    for i in range(runs):
+        elapsed, run_counts, passed = run_once(program)
+        if not passed:
+            return None
+        times.append(elapsed)
+        for name in counter_names:
+            if run_counts.get(name) is not None:
+                counts.setdefault(name, []).append(run_counts[name])
+
+    result = {'time': median(times)}
+    for name in counter_names:
+        result[name] = int(median(counts[name])) if name in counts else None
+    return result
+
+def format_change(current, base, limit):
+    change = (current - base) * 100.0 / base
+    text = '%+.1f%%' % change
+    if change > limit:
+        return red(text + ' REGRESSION'), True
+    if change < -limit:
+        return green(text), False
+    return text, False
+
+shutil.rmtree(output_dir, ignore_errors=True)
+
+compile_cmd = [
+    './compiler',
+    '--eliminate-tail-recursion',
+    '--lib-dir', 'lib',
+    '-o', output_dir
+] + bench_files
+
+Popen(compile_cmd, stdout=PIPE, stderr=STDOUT).stdout.read()
+
+baseline = {}
+if os.path.exists(baseline_file):
+    baseline = json.load(open(baseline_file))
+
+if not use_runner and not use_perf:
+    print('No hardware counters available, comparing wall times only')
+
+padding = max(len(os.path.basename(f)) for f in bench_files) + 1
+results = {}
+failed = False
+
+print('%s %10s %14s %14s %12s %12s  %s' % (
+    'Kernel'.ljust(padding), 'Median ms', 'Instructions', 'Cycles',
+    'Br misses', 'L1D misses', 'Baseline'))
+
+for bench_file in bench_files:
+    name = os.path.basename(bench_file)[:-2]
+    program = os.path.join(output_dir, name)
+    label = os.path.basename(bench_file).ljust(padding)
+
+    if not os.path.exists(program):
+        print(label + red('Compilation Failed'))
+        failed = True
+        continue
+
+    result = measure(program)
+    if result is None:
+        print(label + red('Execution Failed'))
+        failed = True
+        continue
+    results[name] = result
+
+    instructions = result['instructions']
+    comparison = 'none'
+    base = baseline.get(name)
+    if base is not None:
+        if instructions is not None and base.get('instructions'):
+            limit = 5.0 if threshold is None else threshold
+            comparison, regressed = format_change(instructions,
+                                                  base['instructions'], limit)
+        else:
+            limit = 15.0 if threshold is None else threshold
+            comparison, regressed = format_change(result['time'],
+                                                  base['time'], limit)
+        failed = failed or regressed
+
+    def count(name):
+        return '-' if result[name] is None else str(result[name])
+
+    print('%s %10.2f %14s %14s %12s %12s  %s' % (
+        label, result['time'] * 1000, count('instructions'), count('cycles'),
+        count('branch-misses'), count('l1d-misses'), comparison))
+
+if compare_gcc:
+    print('')
+    print('%s %10s %10s %10s' % ('C version'.ljust(padding), 'this ms',
+                                 'gcc -O0', 'gcc -O2'))
+    for bench_file in bench_files:
+        name = os.path.basename(bench_file)[:-2]
+        source = os.path.join(bench_dir, 'c', name + '.c')
+        if name not in results or not os.path.exists(source):
+            continue
+
+        columns = []
+        for level in ['-O0', '-O2']:
+            program = os.path.join(output_dir, name + level)
+            p = Popen(['gcc', level, '-o', program, source],
+                      stdout=PIPE, stderr=STDOUT)
+            p.communicate()
+            result = measure(program) if p.returncode == 0 else None
+            columns.append('%10.2f' % (result['time'] * 1000)
+                           if result else '%10s' % 'failed')
+
+        print('%s %10.2f %s' % (os.path.basename(source).ljust(padding),
+                                results[name]['time'] * 1000,
+                                ' '.join(columns)))
+
+if update_baseline:
+    baseline.update(results)
+    with open(baseline_file, 'w') as f:
+        json.dump(baseline, f, indent=4, sort_keys=True)
+        f.write('\n')
+    print('Baseline written to ' + baseline_file)
+
+sys.exit(1 if failed else 0)
@@ -0,0 +1,266 @@
+#!/usr/bin/python
+#
+# Compile time scalability. Synthesizes programs that grow along one
+# dimension at a time (functions, expression depth, elif chains, imports,
+# string literals, tail calls, errors), compiles each size with --stats and
+# reports the time and memory of the compiler. The growth exponent between
+# consecutive sizes shows how a phase scales, anything clearly worse than
+# linear is flagged.
+#
+# Usage: run-scale.py [options] [dimension...]
+#   --sizes <n>          sizes per dimension, each twice the last, default 4
+#   --scale <f>          multiplies the sizes of every dimension
+#   --runs <n>           compilations per size, the fastest is kept, default 3
+#   --limit <exponent>   growth flagged as super-linear, defaults to 1.5
+#   --keep               keep the generated programs in scale-output
+#
+from subprocess import Popen, PIPE, STDOUT
+import json
+import math
+import os
+import shutil
+import sys
+import time
+
+def red(text):
+    return '\x1B[31m' + text + '\x1B[0m'
+
+output_dir = 'scale-output'
+
+#
+# Generators, each returns the modules of a program of size n as a map from
+# file name to source. The main module is main.u.
+#
+
+def gen_functions(n):
+    lines = []
+    for i in range(n):
+        lines.append('int f%d(int x) {' % i)
+        if i == 0:
+            lines.append('    return x + 1;')
+        else:
+            lines.append('    return f%d(x) + %d;' % (i-1, i % 7))
+        lines.append('}')
+    lines.append('void main() {')
+    lines.append('    var x int;')
+    lines.append('    x = f%d(1);' % (n-1))
+    lines.append('}')
+    return {'main.u': '\n'.join(lines) + '\n'}
+
+def gen_expression_depth(n):
+    terms = ' + '.join('(x * %d - %d)' % (i % 5 + 1, i % 3) for i in range(n))
+    source = 'void main() {\n    var x int;\n    x = 1;\n'
+    source += '    x = ' + terms + ';\n}\n'
+    return {'main.u': source}
+
+def gen_elif_chain(n):
+    lines = ['int classify(int x) {']
+    for i in range(n):
+        keyword = 'if' if i == 0 else '} elif'
+        lines.append('    %s (x == %d) {' % (keyword, i))
+        lines.append('        return %d;' % (i * 3))
+    lines.append('    }')
+    lines.append('    return 0;')
+    lines.append('}')
+    lines.append('void main() {')
+    lines.append('    var x int;')
+    lines.append('    x = classify(%d);' % (n // 2))
+    lines.append('}')
+    return {'main.u': '\n'.join(lines) + '\n'}
+
+def gen_imports(n):
+    files = {}
+    lines = []
+    for i in range(n):
+        files['m%d.u' % i] = 'int value(int x) {\n    return x + %d;\n}\n' % i
+        lines.append('import "m%d";' % i)
+    lines.append('void main() {')
+    lines.append('    var x int;')
+    lines.append('    x = 0;')
+    for i in range(n):
+        lines.append('    x = m%d:value(x);' % i)
+    lines.append('}')
+    files['main.u'] = '\n'.join(lines) + '\n'
+    return files
+
+def gen_strings(n):
+    lines = ['void main() {', '    var s string;']
+    for i in range(n):
+        lines.append('    s = "string literal number %d of the pool";' % i)
+    lines.append('}')
+    return {'main.u': '\n'.join(lines) + '\n'}
+
+def gen_tail_calls(n):
+    lines = ['int count(int x, int acc) {', '    if (x == 0) {',
+             '        return acc;']
+    for i in range(n):
+        lines.append('    } elif (x == %d) {' % (i + 1))
+        lines.append('        return count(x - 1, acc + %d);' % i)
+    lines.append('    }')
+    lines.append('    return count(x - 1, acc);')
+    lines.append('}')
+    lines.append('void main() {')
+    lines.append('    var x int;')
+    lines.append('    x = count(%d, 0);' % n)
+    lines.append('}')
+    return {'main.u': '\n'.join(lines) + '\n'}
+
+def gen_errors(n):
+    lines = ['void main() {', '    var x int;']
+    for i in range(n):
+        lines.append('    x = undefined%d;' % i)
+    lines.append('}')
+    return {'main.u': '\n'.join(lines) + '\n'}
+
+# name, generator, smallest size, whether the program compiles
+dimensions = [
+    ('functions', gen_functions, 500, True),
+    ('expression-depth', gen_expression_depth, 100, True),
+    ('elif-chain', gen_elif_chain, 250, True),
+    ('imports', gen_imports, 50, True),
+    ('strings', gen_strings, 1000, True),
+    ('tail-calls', gen_tail_calls, 250, True),
+    ('errors', gen_errors, 500, False),
+]
+
+size_count = 4
+scale = 1.0
+runs = 3
+limit = 1.5
+keep = False
+selected = []
+
+args = sys.argv[1:]
+while args:
+    arg = args.pop(0)
+    if arg == '--sizes':
+        size_count = int(args.pop(0))
+    elif arg == '--scale':
+        scale = float(args.pop(0))
+    elif arg == '--runs':
+        runs = int(args.pop(0))
+    elif arg == '--limit':
+        limit = float(args.pop(0))
+    elif arg == '--keep':
+        keep = True
+    else:
+        selected.append(arg)
+
+names = [d[0] for d in dimensions]
+for name in selected:
+    if name not in names:
+        print(red('Unknown dimension: ' + name))
+        print('Dimensions: ' + ' '.join(names))
+        sys.exit(1)
+if selected:
+    dimensions = [d for d in dimensions if d[0] in selected]
+
+compiler = os.path.abspath('./compiler')
+lib_dir = os.path.abspath('lib')
+
+# Compiles main.u in dir, returns the stats of the fastest of the runs, or
+# None and the output of the compiler if it didn't behave as expected
+def compile_program(dir, compiles):
+    best = None
+    for i in range(runs):
+        stats_file = os.path.abspath(os.path.join(dir, 'stats.json'))
+        start = time.time()
+        p = Popen([compiler, '--eliminate-tail-recursion', '--lib-dir',
+                   lib_dir, '--stats', stats_file, 'main.u'],
+                  cwd=dir, stdout=PIPE, stderr=STDOUT)
+        output = p.communicate()[0].decode('ASCII', 'replace')
+        elapsed = time.time() - start
+
+        if (p.returncode == 0) != compiles:
+            return None, output
+
+        entry = json.load(open(stats_file))[0]
+        stats = entry['stats']
+        phases = stats['phases']
+        modules = stats['modules']
+        result = {
+            'total': elapsed,
+            'load': phases['load']['wall'],
+            'validate': phases['validate']['wall'],
+            'cgen': sum(m['cgen']['wall'] for m in modules),
+            'link': phases['link']['wall'],
+            'rss': stats['peakRSS'],
+        }
+        if best is None or result['total'] < best['total']:
+            best = result
+    return best, ''
+
+
+# Growth exponent of value between two sizes, None while the values are too
+# small to tell apart from noise
+def exponent(n1, v1, n2, v2, floor):
+    if v1 < floor or v2 < floor:
+        return None
+    return math.log(v2 / v1) / math.log(float(n2) / n1)
+
+def format_exponent(e):
+    if e is None:
+        return '%7s' % '-'
+    text = '%7.2f' % e
+    return red(text) if e > limit else text
+
+shutil.rmtree(output_dir, ignore_errors=True)
+os.mkdir(output_dir)
+
+flagged = []
+columns = ['load', 'validate', 'cgen', 'total']
+floors = {'load': 0.002, 'validate': 0.002, 'cgen': 0.002, 'total': 0.02,
+          'rss': 1024}
+
+for name, generator, smallest, compiles in dimensions:
+    print(name)
+    print('  %8s %9s %9s %9s %9s %9s   %s' %
+          ('size', 'load ms', 'valid ms', 'cgen ms', 'total ms', 'RSS KB',
+           'growth: load validate cgen total rss'))
+
+    previous = None
+    for step in range(size_count):
+        n = int(smallest * scale) * (2 ** step)
+        dir = os.path.join(output_dir, '%s-%d' % (name, n))
+        os.mkdir(dir)
+        for file_name, source in generator(n).items():
+            with open(os.path.join(dir, file_name), 'w') as f:
+                f.write(source)
+
+        result, output = compile_program(dir, compiles)
+        if result is None:
+            message = output.strip().split('\n')[0] if output.strip() else ''
+            print('  %8d %s %s' % (n, red('Compilation did not behave as '
+                                          'expected:'), message))
+            flagged.append('%s: compilation at size %d: %s' %
+                           (name, n, message))
+            break
+
+        growth = ''
+        if previous is not None:
+            pn, presult = previous
+            exponents = []
+            for column in columns + ['rss']:
+                e = exponent(pn, presult[column], n, result[column],
+                             floors[column])
+                exponents.append(format_exponent(e))
+                if e is not None and e > limit:
+                    flagged.append('%s %s: growth %.2f from %d to %d' %
+                                   (name, column, e, pn, n))
+            growth = ' '.join(exponents)
+
+        print('  %8d %9.2f %9.2f %9.2f %9.2f %9d   %s' %
+              (n, result['load'] * 1000, result['validate'] * 1000,
+               result['cgen'] * 1000, result['total'] * 1000,
+               result['rss'], growth))
+        previous = (n, result)
+
+if not keep:
+    shutil.rmtree(output_dir, ignore_errors=True)
+
+if flagged:
+    print('')
+    print(red('Super-linear growth:'))
+    for line in flagged:
+        print('  ' + line)
+    sys.exit(1)
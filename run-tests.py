@@ -1,8 +1,25 @@
 #!/usr/bin/python
+#
+# Usage: run-tests.py [--counters] [--update-budgets] [--whole-program]
+#                     [--skip-unreachable] [test.u...]
+#   --counters         run every test under perf-runner and print the
+#                      instructions it executed. A test that executes more
+#                      than its budget in tests/auto/budgets.json fails.
+#   --update-budgets   store the instruction counts as the new budgets
+#   --whole-program    compile the tests with --whole-program
+#   --skip-unreachable compile the tests with --skip-unreachable
+#
+# A test starting with '# error: [<line>:<column> ]<message>' lines must
+# fail to compile, reporting every one of the messages. A test with a .in
+# file next to it reads it as stdin.
+#
 from subprocess import Popen, PIPE, STDOUT
+import json
 import os
 import glob
+import shutil
 import sys
+import tempfile
 
 def red(text):
     return '\x1B[31m' + text + '\x1B[0m'
@@ -10,41 +27,116 @@ def red(text):
 def green(text):
     return '\x1B[32m' + text + '\x1B[0m'
 
+counters = False
+update_budgets = False
+whole_program = False
+skip_unreachable = False
 test_files = []
-if len(sys.argv) > 1:
-    sys.argv.pop(0)
-    for arg in sys.argv:
+for arg in sys.argv[1:]:
+    if arg == '--counters':
+        counters = True
+    elif arg == '--update-budgets':
+        counters = True
+        update_budgets = True
+    elif arg == '--whole-program':
+        whole_program = True
+    elif arg == '--skip-unreachable':
+        skip_unreachable = True
+    else:
         test_files.append('./tests/auto/' + arg)
-else:
+if not test_files:
     test_files = glob.glob('./tests/auto/*.u')
 
+budgets_file = './tests/auto/budgets.json'
+budgets = {}
+if counters and os.path.exists(budgets_file):
+    budgets = json.load(open(budgets_file))
+counts = {}
+
+if counters and not os.path.exists('./perf-runner'):
+    print(red('perf-runner is not built, run jam first'))
+    sys.exit(1)
+
+# Runs the program under perf-runner, returns the counts it reported
+def run_counted(program, stdin):
+    report = tempfile.NamedTemporaryFile(delete=False)
+    report.close()
+    p = Popen(['./perf-runner', '-o', report.name, program],
+              stdin=stdin, stdout=PIPE, stderr=STDOUT)
+    output = p.stdout.read()
+    p.wait()
+    try:
+        result = json.load(open(report.name))
+    except ValueError:
+        result = {'signal': -1}
+    os.unlink(report.name)
+    return output, result
+
 padding = 0
 for test_file in test_files:
     padding = max(padding, len(os.path.basename(test_file))+1)
 
+for test_file in test_files:
+    if not os.path.exists(test_file):
+        print(red('File does not exist: ' + test_file))
+test_files = [f for f in test_files if os.path.exists(f)]
+
+# Every test is compiled by one invocation into its own executable
+output_dir = 'test-output'
+shutil.rmtree(output_dir, ignore_errors=True)
+
 compile_cmd = [
     './compiler',
     '--eliminate-tail-recursion',
     '--lib-dir', 'lib',
-    ''
-]
+    '-o', output_dir
+] + test_files
+if whole_program:
+    compile_cmd.insert(1, '--whole-program')
+if skip_unreachable:
+    compile_cmd.insert(1, '--skip-unreachable')
 
-for test_file in test_files:
-    if not os.path.exists(test_file):
-        print(red('File does not exist: ' + test_file))
-        continue
+compile_output = Popen(compile_cmd, stdout=PIPE, stderr=STDOUT).stdout.read()
+compile_output = compile_output.decode('ASCII', 'replace').splitlines()
+
+# The errors a test expects, from the comments it starts with
+def expected_errors(test_file):
+    errors = []
+    for line in open(test_file):
+        if not line.startswith('# error: '):
+            break
+        errors.append(line[len('# error: '):].strip())
+    return errors
 
-    compile_cmd[-1] = test_file
-    compile_output = Popen(compile_cmd, stdout=PIPE, stderr=STDOUT).stdout.read()
+for test_file in test_files:
+    program = os.path.join(output_dir, os.path.basename(test_file)[:-2])
     output = ''
+    errors = expected_errors(test_file)
 
-    if len(compile_output) > 0:
+    if errors:
+        reported = [line for line in compile_output
+                    if line.startswith(os.path.basename(test_file) + ' ')]
+        missing = [error for error in errors
+                   if not any(line.endswith(' ' + error) for line in reported)]
+        if os.path.exists(program):
+            output = red('Compiled')
+        elif missing:
+            output = red('Missing Error') + '  ' + missing[0]
+        else:
+            output = green('PASS')
+    elif not os.path.exists(program):
         output = red('Compilation Failed')
     else:
-        p = Popen('./output', stdout=PIPE, stderr=STDOUT)
-        test_output = p.stdout.read()
+        input_file = test_file[:-2] + '.in'
+        stdin = open(input_file) if os.path.exists(input_file) else None
+        if counters:
+            test_output, result = run_counted(program, stdin)
+            ret = -1 if result.get('signal') else 0
+        else:
+            p = Popen(program, stdin=stdin, stdout=PIPE, stderr=STDOUT)
+            test_output = p.stdout.read()
+            ret = p.poll()
         test_output = test_output.decode('ASCII').strip()
-        ret = p.poll()
 
         if ret < 0:
             output = red('Execution Failed')
@@ -57,4 +149,26 @@ for test_file in test_files:
         else:
             output = red('Bad Output')
 
+        if counters:
+            name = os.path.basename(test_file)[:-2]
+            instructions = result.get('instructions')
+            budget = budgets.get(name)
+            if instructions is None:
+                output += '  instructions: not counted'
+            elif (not update_budgets and budget is not None and
+                    instructions > budget):
+                output = red('Over Budget') + '  instructions: %d > %d' % (
+                    instructions, budget)
+            else:
+                output += '  instructions: %d' % instructions
+            if instructions is not None:
+                counts[name] = instructions
+
     print(os.path.basename(test_file).ljust(padding) + output)
+
+if update_budgets:
+    budgets.update(counts)
+    with open(budgets_file, 'w') as f:
+        json.dump(budgets, f, indent=4, sort_keys=True)
+        f.write('\n')
+    print('Budgets written to ' + budgets_file)
@@ -0,0 +1,31 @@
+#include <stdio.h>
+
+static long a[50][50][50];
+
+int main()
+{
+    for (long round = 0; round < 20; round++) {
+        for (long i = 0; i <= 49; i++) {
+            for (long j = 0; j <= 49; j++) {
+                for (long k = 0; k <= 49; k++) {
+                    a[i][j][k] = i*2500 + j*50 + k + round;
+                }
+            }
+        }
+
+        for (long i = 0; i <= 49; i++) {
+            for (long j = 0; j <= 49; j++) {
+                for (long k = 0; k <= 49; k++) {
+                    if (a[i][j][k] != i*2500 + j*50 + k + round) {
+                        puts("FAIL");
+                        return 1;
+                    }
+                }
+            }
+        }
+        __asm__ volatile("" : : "r"(a) : "memory");
+    }
+
+    puts("PASS");
+    return 0;
+}
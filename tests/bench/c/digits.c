@@ -0,0 +1,23 @@
+#include <stdio.h>
+
+long digitSum(long n)
+{
+    long sum = 0;
+    while (n > 0) {
+        sum = sum + n % 10;
+        n = n / 10;
+    }
+    return sum;
+}
+
+int main()
+{
+    long total = 0;
+
+    for (volatile long n = 1; n <= 1000000; n++) {
+        total = total + digitSum(n);
+    }
+
+    puts(total == 27000001 ? "PASS" : "FAIL");
+    return 0;
+}
@@ -0,0 +1,15 @@
+#include <stdio.h>
+
+long fib(long n)
+{
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main()
+{
+    puts(fib(27) == 196418 ? "PASS" : "FAIL");
+    return 0;
+}
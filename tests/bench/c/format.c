@@ -0,0 +1,11 @@
+#include <stdio.h>
+
+int main()
+{
+    for (long i = 1; i <= 1000000; i++) {
+        printf("%ld\n", i * 1234567891 - 600000000000000);
+    }
+
+    puts("PASS");
+    return 0;
+}
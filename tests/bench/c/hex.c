@@ -0,0 +1,11 @@
+#include <stdio.h>
+
+int main()
+{
+    for (long i = 1; i <= 1000000; i++) {
+        printf("%lx\n", i * 2654435761);
+    }
+
+    puts("PASS");
+    return 0;
+}
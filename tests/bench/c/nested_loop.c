@@ -0,0 +1,17 @@
+#include <stdio.h>
+
+int main()
+{
+    volatile long sum = 0;
+
+    for (long i = 0; i <= 199; i++) {
+        for (long j = 0; j <= 199; j++) {
+            for (long k = 0; k <= 199; k++) {
+                sum = sum + i + j + k;
+            }
+        }
+    }
+
+    puts(sum == 2388000000 ? "PASS" : "FAIL");
+    return 0;
+}
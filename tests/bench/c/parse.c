@@ -0,0 +1,18 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+int main()
+{
+    const char* numbers[8] = {"7", "-42", "65535", "12345678", "-987654321",
+        "4294967296", "-3141592653589", "27182818284590"};
+    long total = 0;
+
+    for (volatile long i = 1; i <= 250000; i++) {
+        for (long j = 0; j <= 7; j++) {
+            total = total + strtol(numbers[j], NULL, 10);
+        }
+    }
+
+    puts(total == 6011136338788500000 ? "PASS" : "FAIL");
+    return 0;
+}
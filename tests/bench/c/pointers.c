@@ -0,0 +1,22 @@
+#include <stdio.h>
+
+int main()
+{
+    static long next[4096];
+    static long* cells[4096];
+
+    for (long n = 0; n <= 4095; n++) {
+        next[n] = (n*1597 + 1) % 4096;
+    }
+    for (long n = 0; n <= 4095; n++) {
+        cells[n] = &next[n];
+    }
+
+    long i = 0;
+    for (long steps = 0; steps < 4096000; steps++) {
+        i = *cells[i];
+    }
+
+    puts(i == 0 ? "PASS" : "FAIL");
+    return 0;
+}
@@ -0,0 +1,13 @@
+#include <stdio.h>
+
+// Buffered like the io module
+int main()
+{
+    for (long i = 1; i <= 100000; i++) {
+        puts("The quick brown fox jumps over the lazy dog");
+        printf("%ld\n", i);
+    }
+
+    puts("PASS");
+    return 0;
+}
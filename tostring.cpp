@@ -70,21 +70,53 @@ string ModuleNode::toString() const {
     }
     s += '\n';
 
+    for (size_t i = 0; i < globals.size(); i++) {
+        s += globals[i]->toString() + "\n";
+    }
+    if (!globals.empty()) {
+        s += '\n';
+    }
+
     for (size_t i = 0; i < functions.size(); i++) {
         s += functions[i]->toString() + "\n\n";
     }
     return s;
 }
 
+string Global::toString() const {
+    string s = isConstant ? "const " : "var ";
+    for (size_t i = 0; i < ids.size(); i++) {
+        s += ids[i].str();
+        if (i < ids.size()-1) {
+            s += ", ";
+        }
+    }
+    s += " " + type->toString();
+
+    if (values.size() == 1 && type->form != TF_ARRAY) {
+        s += " = " + values[0]->toString();
+    } else if (!values.empty()) {
+        s += " = {";
+        for (size_t i = 0; i < values.size(); i++) {
+            s += values[i]->toString();
+            if (i < values.size()-1) {
+                s += ", ";
+            }
+        }
+        s += "}";
+    }
+    return s + ";";
+}
+
 string FunctionNode::toString() const {
     string s = "";
     if (block == nullptr) {
         s += "extern ";
     }
-    s += returnType->toString() + " " + id.str + "(";
+    s += returnType->toString() + " " + id.str() + "(";
     for (size_t i = 0; i < arguments.size(); i++) {
         s += arguments[i]->type->toString() + " ";
-        s += arguments[i]->ids[0].str;
+        s += arguments[i]->ids[0].str();
         if (i != arguments.size() - 1) {
             s += ", ";
         }
@@ -98,6 +130,32 @@ string FunctionNode::toString() const {
     return s;
 }
 
+string Statement::toString(int currentIndentLevel) const {
+    switch (kind) {
+        case NK_ASSIGNMENT:
+            return ((const Assignment*)this)->toString(currentIndentLevel);
+        case NK_DECLARATION:
+            return ((const Declaration*)this)->toString(currentIndentLevel);
+        case NK_RETURN:
+            return ((const Return*)this)->toString(currentIndentLevel);
+        case NK_FUNCTION_CALL:
+            return static_cast<const FunctionCall*>(this)
+                ->toString(currentIndentLevel);
+        case NK_IF:
+            return ((const If*)this)->toString(currentIndentLevel);
+        case NK_WHILE:
+            return ((const While*)this)->toString(currentIndentLevel);
+        case NK_SWITCH:
+            return ((const Switch*)this)->toString(currentIndentLevel);
+        case NK_RANGE_FOR:
+            return ((const RangeFor*)this)->toString(currentIndentLevel);
+        case NK_ARRAY_FOR:
+            return ((const ArrayFor*)this)->toString(currentIndentLevel);
+        default:
+            assert(false);
+    }
+}
+
 string Block::toString(int currentIndentLevel) const {
     string s = "{\n";
     for (size_t i = 0; i < statements.size(); i++) {
@@ -115,7 +173,7 @@ string Assignment::toString(int currentIndentLevel) const {
 string Declaration::toString() const {
     string s = "var ";
     for (int i = 0; i < ids.size(); i++) {
-        s += ids[i].str;
+        s += ids[i].str();
         if (i < ids.size()-1) {
             s += ", ";
         }
@@ -133,18 +191,31 @@ string Return::toString(int currentIndentLevel) const {
 }
 
 string RangeFor::toString(int currentIndentLevel) const {
-    return "for (" + decl->type->toString() + " " + decl->ids[0].str + " in " +
+    return "for (" + decl->type->toString() + " " + decl->ids[0].str() + " in " +
             start->toString() + ".." + end->toString() + ") " +
             block->toString(currentIndentLevel);
 }
 
 string ArrayFor::toString(int currentIndentLevel) const {
-    return "for (" + decl->type->toString() + " " + decl->ids[0].str + " in " +
+    return "for (" + decl->type->toString() + " " + decl->ids[0].str() + " in " +
             arrayExpr->toString() + ") " +
             block->toString(currentIndentLevel);
 }
 
 string FunctionCall::toString() const {
+    // As written, without the arguments validate adds
+    switch (builtin) {
+        case BUILTIN_NEW:
+            return "new(" + allocated->toString() + ")";
+        case BUILTIN_NEW_ARRAY:
+            return "new(" + allocated->toString() + ", " +
+                   arguments[0]->toString() + ")";
+        case BUILTIN_DELETE:
+            return "delete " + arguments[0]->toString();
+        default:
+            break;
+    }
+
     string s = id.qualifiedString() + "(";
     for (size_t i = 0; i < arguments.size(); i++) {
         s += arguments[i]->toString();
@@ -180,6 +251,47 @@ string While::toString(int currentIndentLevel) const {
     return s;
 }
 
+string Switch::toString(int currentIndentLevel) const {
+    string s = "switch (" + expr->toString() + ") {\n";
+    for (size_t i = 0; i < cases.size(); i++) {
+        s += indent(currentIndentLevel+1) + "case ";
+        for (size_t j = 0; j < cases[i]->values.size(); j++) {
+            s += to_string(cases[i]->values[j]);
+            if (j != cases[i]->values.size()-1) {
+                s += ", ";
+            }
+        }
+        s += " " + cases[i]->block->toString(currentIndentLevel+1) + "\n";
+    }
+    if (defaultBlock != nullptr) {
+        s += indent(currentIndentLevel+1) + "else ";
+        s += defaultBlock->toString(currentIndentLevel+1) + "\n";
+    }
+    s += indent(currentIndentLevel) + "}";
+    return s;
+}
+
+string Expression::toString() const {
+    switch (kind) {
+        case NK_FUNCTION_CALL:
+            return static_cast<const FunctionCall*>(this)->toString();
+        case NK_BINARY_OP:
+            return ((const BinaryOpExpression*)this)->toString();
+        case NK_UNARY_OP:
+            return ((const UnaryOpExpression*)this)->toString();
+        case NK_VARIABLE:
+            return ((const VariableExpression*)this)->toString();
+        case NK_BOOLEAN_LITERAL:
+            return ((const BooleanLiteral*)this)->toString();
+        case NK_NUMERIC_LITERAL:
+            return ((const NumericLiteral*)this)->toString();
+        case NK_STRING_LITERAL:
+            return ((const StringLiteral*)this)->toString();
+        default:
+            assert(false);
+    }
+}
+
 string BinaryOpExpression::toString() const {
     if (op == OP_ARRAY_ACCESS) {
         return "(" + lhs->toString() + ")[" + rhs->toString() + "]";
@@ -203,7 +315,7 @@ string NumericLiteral::toString() const {
 }
 
 string VariableExpression::toString() const {
-    return id.str;
+    return id.str();
 }
 
 string StringLiteral::toString() const {
@@ -211,10 +323,13 @@ string StringLiteral::toString() const {
 }
 
 string BasicType::toString() const {
-    return symbol.str;
+    return symbol.str();
 }
 
 string ArrayType::toString() const {
+    if (elements == 0) {
+        return base->toString() + "[]";
+    }
     return base->toString() + "[" + to_string(elements) + "]";
 }
 
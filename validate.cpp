@@ -5,37 +5,128 @@
 #include "ErrorCollector.h"
 
 // FIXME
-FunctionNode* currentFunction;
+thread_local FunctionNode* currentFunction;
+// Types and variables created during validation live in the module's arena
+thread_local ModuleNode* currentModule;
 
-string ModuleNode::validate(SymbolTable& symbols)
+vector<Diagnostic> ModuleNode::validate(SymbolTable& symbols,
+                                        const Source& source)
 {
-    ErrorCollector errors(sourceLines, name+".u");
+    ErrorCollector errors(source, name+".u");
 
-    for (shared_ptr<FunctionNode>& function : functions) {
+    validateSignatures(symbols, errors);
+
+    for (FunctionNode* function : functions) {
+        validateBody(function, symbols, errors);
+    }
+
+    return errors.getDiagnostics();
+}
+
+void ModuleNode::validateSignatures(SymbolTable& symbols,
+                                    ErrorCollector& errors)
+{
+    currentModule = this;
+
+    for (Global* global : globals) {
+        global->validate(symbols, errors);
+    }
+
+    for (FunctionNode* function : functions) {
         if (symbols.getFunction(function->id) != nullptr) {
             errors.error(function->location, 
-                         "Redefinition of function " + function->id.str);
+                         "Redefinition of function " + function->id.str());
         } else {
             function->validateSignature(symbols, errors);
             symbols.setFunction(function->id, function);
         }
     }
-    
-    bool mainFound = false;
-    for (shared_ptr<FunctionNode>& function : functions) {
-        function->validateBody(symbols, errors);
-        
-        if (!mainFound && function->id.str == "main") {
-            if (!function->returnType->isVoid()
-                    || !function->arguments.empty()) {
-                errors.error(function->location,
-                             "main must be declared as 'void main()'");
-            }
-            mainFound = true;
+
+    currentModule = nullptr;
+}
+
+void ModuleNode::validateBody(FunctionNode* function, SymbolTable& symbols,
+                              ErrorCollector& errors)
+{
+    currentModule = this;
+
+    function->validateBody(symbols, errors);
+
+    // A redefined main is reported as a redefinition only
+    if (function->id.str() == "main" &&
+            symbols.getFunction(function->id) == function) {
+        if (!function->returnType->isVoid()
+                || !function->arguments.empty()) {
+            errors.error(function->location,
+                         "main must be declared as 'void main()'");
         }
     }
 
-    return errors.getErrorString();
+    currentModule = nullptr;
+}
+
+bool Global::validate(SymbolTable& symbols, ErrorCollector& errors)
+{
+    bool valid = true;
+
+    Type* resolved = type->resolve(symbols, errors);
+    if (resolved == nullptr) {
+        type = unknownType;
+        return false;
+    }
+    type = resolved;
+
+    Type* elementType = type;
+    while (elementType->form == TF_ARRAY) {
+        elementType = ((ArrayType*)elementType)->base;
+    }
+
+    size_t elements = type->size / elementType->size;
+    if (values.size() > elements) {
+        errors.error(location, "Too many initial values for type " +
+                     type->toString());
+        valid = false;
+    }
+
+    for (Expression*& value : values) {
+        // Negative numbers are parsed as a minus applied to a literal
+        if (value->kind == NK_UNARY_OP &&
+                ((UnaryOpExpression*)value)->op == OP_UNARY_MINUS &&
+                ((UnaryOpExpression*)value)->expr->kind == NK_NUMERIC_LITERAL) {
+            NumericLiteral* literal =
+                (NumericLiteral*)((UnaryOpExpression*)value)->expr;
+            SourceLocation location = value->location;
+            value = currentModule->arena.make<NumericLiteral>(
+                (long)-(unsigned long)literal->value);
+            value->location = location;
+        }
+
+        if (value->kind != NK_NUMERIC_LITERAL &&
+                value->kind != NK_BOOLEAN_LITERAL &&
+                value->kind != NK_STRING_LITERAL) {
+            errors.error(value->location, "Initial values must be literals");
+            valid = false;
+        } else if (value->type != elementType) {
+            errors.unexpectedType(value->location, elementType, value->type);
+            valid = false;
+        }
+    }
+
+    for (Symbol& id : ids) {
+        if (symbols.getGlobal(id) != nullptr) {
+            errors.error(location, "Redeclaration of variable: " + id.str());
+            valid = false;
+            continue;
+        }
+
+        Variable* var = currentModule->arena.make<Variable>(type, id, 0);
+        var->isGlobal = true;
+        var->isConstant = isConstant;
+        variables.push_back(var);
+        symbols.setGlobal(id, var);
+    }
+
+    return valid;
 }
 
 bool FunctionNode::validateSignature(SymbolTable& symbols,
@@ -43,7 +134,13 @@ bool FunctionNode::validateSignature(SymbolTable& symbols,
 {
     bool valid = true;
     
-    valid &= returnType->validate(symbols, errors);
+    Type* resolved = returnType->resolve(symbols, errors);
+    if (resolved != nullptr) {
+        returnType = resolved;
+    } else {
+        returnType = unknownType;
+        valid = false;
+    }
 
     if (valid && returnType->size != 8) {
         errors.error(location, "Only 8 byte values may be returned.");
@@ -52,8 +149,10 @@ bool FunctionNode::validateSignature(SymbolTable& symbols,
 
     // validate arguments and set them up as locals
     int argumentStackOffset = 8 * 2; // base pointer & return address
-    for (unique_ptr<Declaration>& argument : arguments) {
-        if (argument->type->validate(symbols, errors)) {
+    for (Declaration* argument : arguments) {
+        Type* type = argument->type->resolve(symbols, errors);
+        if (type != nullptr) {
+            argument->type = type;
             if (argument->type->form == TF_ARRAY) {
                 errors.error(argument->location,
                     "Array arguments are not allowed.");
@@ -61,10 +160,8 @@ bool FunctionNode::validateSignature(SymbolTable& symbols,
                 continue;
             }
 
-            shared_ptr<Variable> var(
-                new Variable(argument->type,
-                             argument->ids[0],
-                             argumentStackOffset));
+            Variable* var = currentModule->arena.make<Variable>(
+                argument->type, argument->ids[0], argumentStackOffset);
             locals.push_back(var);
             argumentStackOffset += argument->type->size;
         } else {
@@ -85,14 +182,13 @@ bool FunctionNode::validateBody(SymbolTable& symbols,
     }
 
     // arguments are already in the locals list, put them in the symbol table
-    for (shared_ptr<Variable>& var : locals) {
-        symbols.setVariable(var->symbol.str, var);
+    for (Variable* var : locals) {
+        symbols.setVariable(var->symbol.name, var);
     }
 
-    for (unique_ptr<Statement>& statement : block->statements) {
-        Declaration* decl = dynamic_cast<Declaration*>(statement.get());
-        if (decl != nullptr) {
-            decl->inOuterBlock = true;
+    for (Statement* statement : block->statements) {
+        if (statement->kind == NK_DECLARATION) {
+            ((Declaration*)statement)->inOuterBlock = true;
         }
     }
 
@@ -102,8 +198,8 @@ bool FunctionNode::validateBody(SymbolTable& symbols,
 
     if (!returnType->isVoid() &&
             (block->statements.empty() ||
-             dynamic_cast<Return*>(block->statements.back().get()) == nullptr)) {
-        errors.error(location, "Function " + id.str +
+             block->statements.back()->kind != NK_RETURN)) {
+        errors.error(location, "Function " + id.str() +
                      " does not end with a return statement");
         valid = false;
     }
@@ -117,15 +213,55 @@ bool FunctionNode::validateBody(SymbolTable& symbols,
     return valid;
 }
 
+bool Statement::validate(SymbolTable& symbols, ErrorCollector& errors)
+{
+    switch (kind) {
+        case NK_ASSIGNMENT:
+            return ((Assignment*)this)->validate(symbols, errors);
+        case NK_DECLARATION:
+            return ((Declaration*)this)->validate(symbols, errors);
+        case NK_RETURN:
+            return ((Return*)this)->validate(symbols, errors);
+        case NK_FUNCTION_CALL:
+            return static_cast<FunctionCall*>(this)->validate(symbols, errors);
+        case NK_IF:
+            return ((If*)this)->validate(symbols, errors);
+        case NK_WHILE:
+            return ((While*)this)->validate(symbols, errors);
+        case NK_SWITCH:
+            return ((Switch*)this)->validate(symbols, errors);
+        case NK_RANGE_FOR:
+            return ((RangeFor*)this)->validate(symbols, errors);
+        case NK_ARRAY_FOR:
+            return ((ArrayFor*)this)->validate(symbols, errors);
+        default:
+            assert(false);
+    }
+}
+
 bool Block::validate(SymbolTable& symbols, ErrorCollector& errors)
 {
     bool valid = true;
-    for (unique_ptr<Statement>& statement : statements) {
+    for (Statement* statement : statements) {
         valid &= statement->validate(symbols, errors);
     }
     return valid;
 }
 
+// The constant an lvalue is an element of, or nullptr
+static VariableExpression* constantBase(Expression* lvalue)
+{
+    Expression* base = lvalue;
+    while (base->kind == NK_BINARY_OP) {
+        base = ((BinaryOpExpression*)base)->lhs;
+    }
+    if (base->kind == NK_VARIABLE &&
+            ((VariableExpression*)base)->variable->isConstant) {
+        return (VariableExpression*)base;
+    }
+    return nullptr;
+}
+
 bool Assignment::validate(SymbolTable& symbols, ErrorCollector& errors)
 {
     if (!lhs->validate(symbols, errors)) {
@@ -142,12 +278,19 @@ bool Assignment::validate(SymbolTable& symbols, ErrorCollector& errors)
         return false;
     }
 
+    VariableExpression* constant = constantBase(lhs);
+    if (constant != nullptr) {
+        errors.error(lhs->location, "Cannot assign to constant " +
+                     constant->id.str());
+        return false;
+    }
+
     if (!rhs->validate(symbols, errors)) {
         return false;
     }
 
-    if (!lhs->type->isCompatible(rhs->type.get())) {
-        errors.unexpectedType(location, lhs->type.get(), rhs->type.get());
+    if (lhs->type != rhs->type) {
+        errors.unexpectedType(location, lhs->type, rhs->type);
         return false;
     }
 
@@ -174,22 +317,29 @@ bool Declaration::validate(SymbolTable& symbols, ErrorCollector& errors)
         return false;
     }
 
-    valid &= type->validate(symbols, errors);
+    Type* resolved = type->resolve(symbols, errors);
+    if (resolved != nullptr) {
+        type = resolved;
+    } else {
+        type = unknownType;
+        valid = false;
+    }
 
     for (Symbol& id : ids) {
         currentFunction->stackSpaceForLocals += type->size;
         int stackOffset = -currentFunction->stackSpaceForLocals;
 
-        shared_ptr<Variable> var(new Variable(type, id, stackOffset));
+        Variable* var =
+            currentModule->arena.make<Variable>(type, id, stackOffset);
 
-        if (symbols.getVariable(id.str) != nullptr) {
-            errors.error(location, "Redeclaration of variable: " + id.str);
+        if (symbols.getVariable(id.name) != nullptr) {
+            errors.error(location, "Redeclaration of variable: " + id.str());
             valid = false;
         }
 
         currentFunction->locals.push_back(var);
 
-        symbols.setVariable(id.str, var);
+        symbols.setVariable(id.name, var);
     }
 
     return valid;
@@ -198,35 +348,94 @@ bool Declaration::validate(SymbolTable& symbols, ErrorCollector& errors)
 bool Return::validate(SymbolTable& symbols, ErrorCollector& errors)
 {
     if (currentFunction->isTailRecursive) {
-        FunctionCall* call = dynamic_cast<FunctionCall*>(expr.get());
-        if (call != nullptr) {
-            currentFunction->tailCalls.insert(call);
+        if (expr->kind == NK_FUNCTION_CALL) {
+            currentFunction->tailCalls.insert(static_cast<FunctionCall*>(expr));
         }
     }
 
     bool exprIsValid = expr->validate(symbols, errors);
-    if (!expr->type->isCompatible(currentFunction->returnType.get())) {
+    if (expr->type != currentFunction->returnType) {
         errors.unexpectedType(location,
-            currentFunction->returnType.get(), expr->type.get());
+            currentFunction->returnType, expr->type);
     }
 
     return exprIsValid;
 }
 
+// The count and the size of the type are passed on to mem:alloc, which
+// returns an int. The call is typed as a pointer to the type, or to an
+// array of it of unknown length when there is a count.
+bool FunctionCall::validateNew(SymbolTable& symbols, ErrorCollector& errors)
+{
+    allocated = allocated->resolve(symbols, errors);
+    if (allocated == nullptr) {
+        return false;
+    }
+    if (allocated->isVoid()) {
+        errors.error(Statement::location, "Cannot allocate void");
+        return false;
+    }
+
+    Arena& arena = currentModule->arena;
+    if (builtin == BUILTIN_NEW) {
+        arguments.push_back(arena.make<NumericLiteral>(1));
+        arguments.back()->location = Statement::location;
+        type = pointerType(allocated);
+    } else {
+        type = pointerType(arrayType(allocated, 0));
+    }
+    arguments.push_back(arena.make<NumericLiteral>(allocated->size));
+    arguments.back()->location = Statement::location;
+    return true;
+}
+
+// Whether module imports the module of the given name, which is the last
+// part of the import's path
+static bool importsModule(ModuleNode* module, const string& name)
+{
+    for (Import& import : module->imports) {
+        const string& path = import.path.str;
+        size_t slash = path.find_last_of('/');
+        if (!import.isAssembly &&
+                path.compare(slash == string::npos ? 0 : slash+1,
+                             string::npos, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool FunctionCall::validate(SymbolTable& symbols, ErrorCollector& errors)
 {
     function = symbols.getFunction(id);
 
     if (function == nullptr) {
-        errors.undefinedFunction(Statement::location, id.str);
+        errors.undefinedFunction(Statement::location, id.str());
+        return false;
+    }
+
+    // The symbol table holds the functions of every module validated so
+    // far, only those of the module and its imports can be called
+    const string& module = function->id.moduleString();
+    if (module != currentModule->name &&
+            !importsModule(currentModule, module)) {
+        errors.error(Statement::location, "Module " + module +
+                     " is not imported");
         return false;
     }
 
     type = function->returnType;
 
+    if ((builtin == BUILTIN_NEW || builtin == BUILTIN_NEW_ARRAY) &&
+            !validateNew(symbols, errors)) {
+        return false;
+    }
+
+    currentFunction->callees.insert(function);
+
     if (function->arguments.size() != arguments.size()) {
         errors.error(Statement::location, "Invalid number of arguments "
-                     "for function call: " + id.str);
+                     "for function call: " + id.str());
         return false;
     }
 
@@ -235,7 +444,7 @@ bool FunctionCall::validate(SymbolTable& symbols, ErrorCollector& errors)
     temporarySpace = 0;
 
     for (size_t i = 0; i < function->arguments.size(); i++) {
-        shared_ptr<Type> expected = function->arguments[i]->type;
+        Type* expected = function->arguments[i]->type;
         if (!arguments[i]->validate(symbols, errors)) {
             continue;
         }
@@ -244,10 +453,18 @@ bool FunctionCall::validate(SymbolTable& symbols, ErrorCollector& errors)
             temporarySpace = arguments[i]->temporarySpace;
         }
 
-        Type* actual = arguments[i]->type.get();
-        if (!expected->isCompatible(actual)) {
+        Type* actual = arguments[i]->type;
+        if (builtin == BUILTIN_DELETE) {
+            if (actual->form != TF_POINTER) {
+                errors.error(arguments[i]->location, "Expected pointer type");
+                return false;
+            }
+        } else if (builtin != BUILTIN_NONE && expected != actual) {
+            errors.unexpectedType(arguments[i]->location, expected, actual);
+            return false;
+        } else if (expected != actual) {
             errors.error(Statement::location, "Argument type mismatch in call "
-                         "to function: " + id.str);
+                         "to function: " + id.str());
             return false;
         }
 
@@ -259,7 +476,7 @@ bool FunctionCall::validate(SymbolTable& symbols, ErrorCollector& errors)
     }
 
     if (currentFunction->isTailRecursive &&
-            function.get() == currentFunction &&
+            function == currentFunction &&
             currentFunction->tailCalls.find(this) ==
                 currentFunction->tailCalls.end()) {
         currentFunction->isTailRecursive = false;
@@ -276,7 +493,7 @@ bool If::validate(SymbolTable& symbols, ErrorCollector& errors)
         if (predicate->validate(symbols, errors)) {
             if (!predicate->type->isBasicType(T_BOOL)) {
                 errors.unexpectedType(predicate->location,
-                    new BasicType(T_BOOL), predicate->type.get());
+                    boolType, predicate->type);
                 valid = false;
             }
         } else {
@@ -300,8 +517,7 @@ bool While::validate(SymbolTable& symbols, ErrorCollector& errors)
     if (expr != nullptr) {
         if (expr->validate(symbols, errors)) {
             if (!expr->type->isBasicType(T_BOOL)) {
-                errors.unexpectedType(expr->location, new BasicType(T_BOOL),
-                    expr->type.get());
+                errors.unexpectedType(expr->location, boolType, expr->type);
                 valid = false;
             }
         } else {
@@ -314,6 +530,42 @@ bool While::validate(SymbolTable& symbols, ErrorCollector& errors)
     return valid;
 }
 
+bool Switch::validate(SymbolTable& symbols, ErrorCollector& errors)
+{
+    bool valid = true;
+
+    if (expr->validate(symbols, errors)) {
+        if (!expr->type->isBasicType(T_INT64)) {
+            errors.unexpectedType(expr->location, int64Type, expr->type);
+            valid = false;
+        }
+    } else {
+        valid = false;
+    }
+
+    if (expr->temporarySpace > currentFunction->temporarySpace) {
+        currentFunction->temporarySpace = expr->temporarySpace;
+    }
+
+    set<long> seen;
+    for (SwitchCase* switchCase : cases) {
+        for (long value : switchCase->values) {
+            if (!seen.insert(value).second) {
+                errors.error(switchCase->location,
+                             "Duplicate case value: " + to_string(value));
+                valid = false;
+            }
+        }
+        valid &= switchCase->block->validate(symbols, errors);
+    }
+
+    if (defaultBlock != nullptr) {
+        valid &= defaultBlock->validate(symbols, errors);
+    }
+
+    return valid;
+}
+
 bool RangeFor::validate(SymbolTable& symbols, ErrorCollector& errors)
 {
     // FIXME
@@ -323,7 +575,7 @@ bool RangeFor::validate(SymbolTable& symbols, ErrorCollector& errors)
         return false;
     }
 
-    var = symbols.getVariable(decl->ids[0].str);
+    var = symbols.getVariable(decl->ids[0].name);
 
     if (!var->type->isBasicType(T_INT64)) {
         errors.error(location, "For loop variable must have type 'int'");
@@ -348,7 +600,7 @@ bool RangeFor::validate(SymbolTable& symbols, ErrorCollector& errors)
 
     if (!start->type->isBasicType(T_INT64) ||
             !end->type->isBasicType(T_INT64)) {
-        errors.unexpectedType(location, new BasicType(T_INT64), var->type.get());
+        errors.unexpectedType(location, int64Type, var->type);
         return false;
     }
 
@@ -356,7 +608,7 @@ bool RangeFor::validate(SymbolTable& symbols, ErrorCollector& errors)
         return false;
     }
 
-    symbols.removeVariable(decl->ids[0].str);
+    symbols.removeVariable(decl->ids[0].name);
 
     return true;
 }
@@ -370,6 +622,40 @@ bool ArrayFor::validate(SymbolTable& symbols, ErrorCollector& errors)
 // Expressions
 //
 
+bool Expression::validate(SymbolTable& symbols, ErrorCollector& errors)
+{
+    switch (kind) {
+        case NK_FUNCTION_CALL:
+            return static_cast<FunctionCall*>(this)->validate(symbols, errors);
+        case NK_BINARY_OP:
+            return ((BinaryOpExpression*)this)->validate(symbols, errors);
+        case NK_UNARY_OP:
+            return ((UnaryOpExpression*)this)->validate(symbols, errors);
+        case NK_VARIABLE:
+            return ((VariableExpression*)this)->validate(symbols, errors);
+        case NK_BOOLEAN_LITERAL:
+        case NK_NUMERIC_LITERAL:
+        case NK_STRING_LITERAL:
+            return ((Literal*)this)->validate(symbols, errors);
+        default:
+            assert(false);
+    }
+}
+
+bool Expression::isAddressable() const
+{
+    switch (kind) {
+        case NK_BINARY_OP:
+            return ((BinaryOpExpression*)this)->isAddressable();
+        case NK_UNARY_OP:
+            return ((UnaryOpExpression*)this)->isAddressable();
+        case NK_VARIABLE:
+            return ((VariableExpression*)this)->isAddressable();
+        default:
+            return false;
+    }
+}
+
 bool BinaryOpExpression::validate(SymbolTable& symbols, ErrorCollector& errors)
 {
     bool valid = true;
@@ -391,10 +677,10 @@ bool BinaryOpExpression::validate(SymbolTable& symbols, ErrorCollector& errors)
         // When LHS is a pointer to an array, automatically dereference it
         // This lets us write array_ptr[i] instead of (*array_ptr)[i]
         if (lhs->type->form == TF_POINTER &&
-            ((PointerType*)lhs->type.get())->base->form == TF_ARRAY) {
+            ((PointerType*)lhs->type)->base->form == TF_ARRAY) {
 
-            shared_ptr<Type> baseType = ((PointerType*)lhs->type.get())->base;
-            lhs = unique_ptr<Expression>(new UnaryOpExpression(OP_DEREF, lhs));
+            Type* baseType = ((PointerType*)lhs->type)->base;
+            lhs = currentModule->arena.make<UnaryOpExpression>(OP_DEREF, lhs);
             lhs->type = baseType;
         }
 
@@ -404,11 +690,10 @@ bool BinaryOpExpression::validate(SymbolTable& symbols, ErrorCollector& errors)
             return false;
         }
         if (!rhs->type->isBasicType(T_INT64)) {
-            errors.unexpectedType(rhs->location, new BasicType(T_INT64),
-                                    rhs->type.get());
+            errors.unexpectedType(rhs->location, int64Type, rhs->type);
             return false;
         }
-        type = ((ArrayType*)lhs->type.get())->base;
+        type = ((ArrayType*)lhs->type)->base;
         return true;
     }
 
@@ -456,7 +741,7 @@ bool BinaryOpExpression::validate(SymbolTable& symbols, ErrorCollector& errors)
         return false;
     }
 
-    type.reset(new BasicType(resultType));
+    type = resultType == T_BOOL ? boolType : int64Type;
     return true;
 }
 
@@ -486,19 +771,26 @@ bool UnaryOpExpression::validate(SymbolTable& symbols, ErrorCollector& errors)
                              + expr->type->toString());
             return false;
         }
-        type.reset(new BasicType(expectedType));
+        type = expectedType == T_BOOL ? boolType : int64Type;
     } else if (op == OP_ADDRESS) {
         if (!expr->isAddressable()) {
             errors.error(expr->location, "Expression is not addressable");
             return false;
         }
-        type.reset(new PointerType(expr->type));
+        // Constants are in read only memory
+        VariableExpression* constant = constantBase(expr);
+        if (constant != nullptr) {
+            errors.error(expr->location, "Cannot take the address of constant "
+                         + constant->id.str());
+            return false;
+        }
+        type = pointerType(expr->type);
     } else if (op == OP_DEREF) {
         if (expr->type->form != TF_POINTER) {
             errors.error(expr->location, "Expected pointer type");
             return false;
         }
-        type = ((PointerType*)expr->type.get())->base;
+        type = ((PointerType*)expr->type)->base;
     } else {
         assert(false);
     }
@@ -508,10 +800,14 @@ bool UnaryOpExpression::validate(SymbolTable& symbols, ErrorCollector& errors)
 
 bool VariableExpression::validate(SymbolTable& symbols, ErrorCollector& errors)
 {
-    shared_ptr<Variable> var = symbols.getVariable(id.str);
+    // Locals hide the globals of the module
+    Variable* var = symbols.getVariable(id.name);
+    if (var == nullptr) {
+        var = symbols.getGlobal(id);
+    }
 
     if (var == nullptr) {
-        errors.undefinedVariable(location, id.str);
+        errors.undefinedVariable(location, id.str());
         return false;
     }
 
@@ -525,22 +821,48 @@ bool VariableExpression::validate(SymbolTable& symbols, ErrorCollector& errors)
 // Types
 //
 
-bool BasicType::validate(SymbolTable& symbols, ErrorCollector& errors)
+Type* BasicType::resolve(SymbolTable& symbols, ErrorCollector& errors)
 {
-    typeId = symbols.getBasicTypeId(symbol.str);
-    if (typeId == T_UNKNOWN) {
-        errors.error(location, "Undefined type: " + symbol.str);
-        return false;
+    if (typeId != T_UNKNOWN) {
+        return basicType(typeId);
     }
-    return true;
+
+    BasicTypeId id = symbols.getBasicTypeId(symbol.name);
+    if (id == T_UNKNOWN) {
+        errors.error(location, "Undefined type: " + symbol.str());
+        return nullptr;
+    }
+    return basicType(id);
 }
 
-bool ArrayType::validate(SymbolTable& symbols, ErrorCollector& errors)
+Type* ArrayType::resolve(SymbolTable& symbols, ErrorCollector& errors)
 {
-    return base->validate(symbols, errors);
+    // A T[] has no size, only a pointer to one can be declared
+    if (elements == 0) {
+        errors.error(location, "Array of unknown length must be behind a "
+                     "pointer: " + toString());
+        return nullptr;
+    }
+    Type* resolved = base->resolve(symbols, errors);
+    if (resolved == nullptr) {
+        return nullptr;
+    }
+    return arrayType(resolved, elements);
 }
 
-bool PointerType::validate(SymbolTable& symbols, ErrorCollector& errors)
+Type* PointerType::resolve(SymbolTable& symbols, ErrorCollector& errors)
 {
-    return base->validate(symbols, errors);
+    if (base->form == TF_ARRAY && ((ArrayType*)base)->elements == 0) {
+        Type* elementType = ((ArrayType*)base)->base->resolve(symbols, errors);
+        if (elementType == nullptr) {
+            return nullptr;
+        }
+        return pointerType(arrayType(elementType, 0));
+    }
+
+    Type* resolved = base->resolve(symbols, errors);
+    if (resolved == nullptr) {
+        return nullptr;
+    }
+    return pointerType(resolved);
 }